@@ -0,0 +1,238 @@
+#pragma once
+// index of every bracket in buffer, for matching brackets anywhere in the text.
+// entries live in a gap buffer of their own whose gap follows the edits. entries before
+// the gap hold absolute positions and entries after it are relative to `delta`, so an
+// edit never touches the entries past it. fixed blocks of storage slots carry depth
+// summaries, so matching skips whole blocks instead of walking every bracket between.
+
+#define BRACKET_BLOCK 512 // storage slots summarized together
+#define BRACKET_POS_MASK 0x7FFFFFFF // positions are stored shifted by one bit
+
+static inline bool is_bracket(u32 ch) {
+  return ch == '(' || ch == ')' || ch == '[' || ch == ']' || ch == '{' || ch == '}';
+}
+
+static inline bool _brk_is_close(u32 ch) { return ch == ')' || ch == ']' || ch == '}'; }
+
+// true if open and close form a pair of the same kind
+static inline bool _brk_pairs(u32 open, u32 close) {
+  return (open == '(' && close == ')') || (open == '[' && close == ']') || (open == '{' && close == '}');
+}
+
+static inline u32 _brk_entry(u32 pos, u32 ch) { return ((pos & BRACKET_POS_MASK) << 1) | _brk_is_close(ch); }
+
+// position of the entry in storage slot s
+static inline u32 _brk_slot_pos(struct brackets* br, u32 s) {
+  u32 pos = br->at.start[s] >> 1;
+  return (s > br->at.ce ? pos + br->delta : pos) & BRACKET_POS_MASK;
+}
+
+// position of the i-th bracket in buffer
+static inline u32 _brk_pos(struct brackets* br, u32 i) {
+  return _brk_slot_pos(br, GAP_GET_BUFFER_INDEX(&br->at, i));
+}
+
+static void bracket_free(struct brackets* br) {
+  gap_free(&br->at);
+  mem_free(mem_brackets, br->blocks);
+  br->blocks = NULL;
+  br->nblocks = 0;
+}
+
+// keeps one summary per block of storage. all summaries are invalidated if the storage
+// moved its slots around (growing moves everything after the gap)
+static void _brk_fit(struct brackets* br, bool moved) {
+  u32 need = br->at.capacity / BRACKET_BLOCK + 1;
+  if (need > br->nblocks) {
+    struct bracket_block* blocks = mem_realloc(mem_brackets, br->blocks, sizeof(struct bracket_block) * need);
+    if (blocks == NULL) {
+      perror("failed to grow bracket index");
+      exit(-1);
+    }
+    br->blocks = blocks;
+    for (u32 b = br->nblocks; b < need; b++) {
+      br->blocks[b].dirty = true;
+    }
+    br->nblocks = need;
+  }
+  if (moved) {
+    for (u32 b = 0; b < br->nblocks; b++) {
+      br->blocks[b].dirty = true;
+    }
+  }
+}
+
+static void bracket_init(struct brackets* br) {
+  br->at = gap_init(INIT_BUFFER_SIZE, mem_brackets);
+  br->delta = 0;
+  br->blocks = NULL;
+  br->nblocks = 0;
+  _brk_fit(br, false);
+}
+
+static inline void _brk_dirty(struct brackets* br, u32 s) { br->blocks[s / BRACKET_BLOCK].dirty = true; }
+
+static struct bracket_block* _brk_block(struct brackets* br, u32 b) {
+  struct bracket_block* blk = &br->blocks[b];
+  if (!blk->dirty) return blk;
+  GapBuffer* g = &br->at;
+  u32 first = b * BRACKET_BLOCK, last = MIN(first + BRACKET_BLOCK, g->end + 1);
+  i32 depth = 0;
+  blk->min_pre = 0;
+  for (u32 s = first; s < last; s++) {
+    if (s >= g->c && s <= g->ce) continue;
+    depth += (g->start[s] & 1) ? -1 : 1;
+    blk->min_pre = MIN(blk->min_pre, depth);
+  }
+  blk->sum = depth;
+  depth = 0;
+  blk->min_suf = 0;
+  for (u32 s = last; s-- > first;) {
+    if (s >= g->c && s <= g->ce) continue;
+    depth += (g->start[s] & 1) ? 1 : -1;
+    blk->min_suf = MIN(blk->min_suf, depth);
+  }
+  blk->dirty = false;
+  return blk;
+}
+
+// marks blocks of storage slots [from, to) as changed
+static void _brk_dirty_range(struct brackets* br, u32 from, u32 to) {
+  for (u32 b = from / BRACKET_BLOCK; b * BRACKET_BLOCK < to; b++) {
+    br->blocks[b].dirty = true;
+  }
+}
+
+// moves the gap of the index to pos: brackets before pos end up in front of the gap.
+// entries that cross the gap switch between absolute and relative positions
+static void _brk_seek(struct brackets* br, u32 pos) {
+  GapBuffer* g = &br->at;
+  u32 lo = 0, hi = GAP_LEN(g); // first entry at or past pos
+  while (lo < hi) {
+    u32 mid = lo + (hi - lo) / 2;
+    if (_brk_pos(br, mid) < pos) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < g->c) {
+    u32 n = g->c - lo;
+    gap_left(g, n);
+    for (u32 s = g->ce + 1; s <= g->ce + n; s++) {
+      g->start[s] = (((g->start[s] >> 1) - br->delta) & BRACKET_POS_MASK) << 1 | (g->start[s] & 1);
+    }
+    _brk_dirty_range(br, g->c, g->ce + n + 1);
+  } else if (lo > g->c) {
+    u32 n = lo - g->c;
+    gap_right(g, n);
+    for (u32 s = g->c - n; s < g->c; s++) {
+      g->start[s] = (((g->start[s] >> 1) + br->delta) & BRACKET_POS_MASK) << 1 | (g->start[s] & 1);
+    }
+    _brk_dirty_range(br, g->c - n, g->ce + 1);
+  }
+}
+
+// n characters of text were inserted at pos
+static void bracket_insert(struct brackets* br, u32 pos, const u32* text, u32 n) {
+  _brk_seek(br, pos);
+  for (u32 i = 0; i < n; i++) {
+    if (!is_bracket(text[i])) continue;
+    u32 capacity = br->at.capacity;
+    gap_insert(&br->at, _brk_entry(pos + i, text[i]));
+    _brk_fit(br, capacity != br->at.capacity);
+    _brk_dirty(br, br->at.c - 1);
+  }
+  br->delta += n;
+}
+
+// n characters before pos were removed
+static void bracket_remove(struct brackets* br, u32 pos, u32 n) {
+  _brk_seek(br, pos);
+  GapBuffer* g = &br->at;
+  while (g->c > 0 && _brk_slot_pos(br, g->c - 1) >= pos - n) {
+    gap_remove(g);
+    _brk_dirty(br, g->c);
+  }
+  br->delta -= n;
+}
+
+// n characters of text were appended at pos, the end of buffer
+static void bracket_append(struct brackets* br, u32 pos, const u32* text, u32 n) {
+  for (u32 i = 0; i < n; i++) {
+    if (!is_bracket(text[i])) continue;
+    u32 entry = _brk_entry(pos + i - br->delta, text[i]); // always past the gap
+    gap_append_n(&br->at, &entry, 1);
+    _brk_fit(br, false);
+    _brk_dirty(br, br->at.end);
+  }
+}
+
+// storage slot of the bracket at pos. returns false if there is none
+static bool _brk_find(struct brackets* br, u32 pos, u32* slot) {
+  u32 lo = 0, hi = GAP_LEN(&br->at);
+  while (lo < hi) {
+    u32 mid = lo + (hi - lo) / 2;
+    if (_brk_pos(br, mid) < pos) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == GAP_LEN(&br->at) || _brk_pos(br, lo) != pos) return false;
+  *slot = GAP_GET_BUFFER_INDEX(&br->at, lo);
+  return true;
+}
+
+// finds the partner of the bracket at pos by nesting depth, whatever its kind is.
+// returns false if pos is not a bracket or it is unbalanced
+static bool bracket_match(struct brackets* br, u32 pos, u32* match) {
+  u32 from;
+  if (!_brk_find(br, pos, &from)) return false;
+  GapBuffer* g = &br->at;
+  i64 depth = 1;
+  if ((g->start[from] & 1) == 0) { // opening bracket, walk forward
+    for (u64 s = from + 1; s <= g->end;) {
+      if (s >= g->c && s <= g->ce) {
+        s = g->ce + 1;
+        continue;
+      }
+      if (s % BRACKET_BLOCK == 0 && s + BRACKET_BLOCK - 1 <= g->end) {
+        struct bracket_block* blk = _brk_block(br, s / BRACKET_BLOCK);
+        if (depth + blk->min_pre > 0) {
+          depth += blk->sum;
+          s += BRACKET_BLOCK;
+          continue;
+        }
+      }
+      depth += (g->start[s] & 1) ? -1 : 1;
+      if (depth == 0) {
+        *match = _brk_slot_pos(br, s);
+        return true;
+      }
+      s++;
+    }
+  } else { // closing bracket, walk backward
+    for (i64 s = (i64)from - 1; s >= 0;) {
+      if (s >= g->c && s <= g->ce) {
+        s = (i64)g->c - 1;
+        continue;
+      }
+      if ((s + 1) % BRACKET_BLOCK == 0) {
+        struct bracket_block* blk = _brk_block(br, s / BRACKET_BLOCK);
+        if (depth + blk->min_suf > 0) {
+          depth -= blk->sum;
+          s -= BRACKET_BLOCK;
+          continue;
+        }
+      }
+      depth += (g->start[s] & 1) ? 1 : -1;
+      if (depth == 0) {
+        *match = _brk_slot_pos(br, s);
+        return true;
+      }
+      s--;
+    }
+  }
+  return false;
+}
@@ -9,6 +9,8 @@ enum {
   COMMENT_PAIR,
   CURS_PAIR,
   TXT_GREEN,
+  TXT_ORANGE,
+  TXT_RED,
 };
 
 #define bg 0
@@ -19,6 +21,8 @@ statln[2],
 comment[2],
 statln_warn[2],
 txt_green[2],
+txt_orange[2],
+txt_red[2],
 curs[2];
 
 typedef enum {
@@ -32,6 +36,8 @@ static void set_default_light() {
   statln_warn[bg] = statln[bg]; statln_warn[fg] = COLOR_RED;
   curs[bg] = 34; curs[fg] = editor[bg];
   txt_green[bg] = editor[bg]; txt_green[fg] = 34;
+  txt_orange[bg] = editor[bg]; txt_orange[fg] = 172;
+  txt_red[bg] = editor[bg]; txt_red[fg] = 160;
 }
 
 void set_theme(Theme theme) {
@@ -44,5 +50,7 @@ void set_theme(Theme theme) {
   init_pair(STATLN_WARN_PAIR, statln_warn[fg], statln_warn[bg]);
   init_pair(CURS_PAIR, curs[fg], curs[bg]);
   init_pair(TXT_GREEN, txt_green[fg], txt_green[bg]);
+  init_pair(TXT_ORANGE, txt_orange[fg], txt_orange[bg]);
+  init_pair(TXT_RED, txt_red[fg], txt_red[bg]);
 }
 
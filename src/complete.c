@@ -0,0 +1,84 @@
+#pragma once
+// completion of the word before the cursor from the words of buffer. every word is
+// counted in include/trie.h as text is loaded, and each edit takes out the words around
+// it and puts back what they became, so the index never needs a rescan. ctrl-n inserts
+// the most frequent word starting with the one before the cursor, pressing it again
+// right away cycles through the others.
+
+#define COMPLETE_MIN 3 // shortest word worth completing to
+
+static void editor_replace(Editor* ed, u32 start, u32 end, const u32* text, u32 n);
+
+static inline bool is_word(u32 ch) {
+  if (ch < 0x80) return ch == '_' || isalnum(ch);
+  return !utf8_is_escape(ch) && iswalnum(ch);
+}
+
+static inline u32 _word_start(Editor* ed, u32 i) {
+  while (i > 0 && is_word(gap_get(&ed->buffer, i - 1))) i--;
+  return i;
+}
+
+static inline u32 _word_end(Editor* ed, u32 i) {
+  u32 len = GAP_LEN(&ed->buffer);
+  while (i < len && is_word(gap_get(&ed->buffer, i))) i++;
+  return i;
+}
+
+// counts every word in [from, to) by delta, both ends being word boundaries
+static void _words_count(Editor* ed, u32 from, u32 to, i32 delta) {
+  u32 word[TRIE_DEPTH], len = 0;
+  for (u32 i = from; i <= to; i++) {
+    u32 ch = i < to ? gap_get(&ed->buffer, i) : 0;
+    if (i < to && is_word(ch)) {
+      if (len < TRIE_DEPTH) word[len] = ch;
+      len++;
+      continue;
+    }
+    if (len >= COMPLETE_MIN) trie_add(&ed->complete.words, word, len, delta);
+    len = 0;
+  }
+}
+
+// takes the words touching [from, to) out of the index before they are edited.
+// ws and we are set to where they start and end
+static inline void words_drop(Editor* ed, u32 from, u32 to, u32* ws, u32* we) {
+  *ws = _word_start(ed, from);
+  *we = _word_end(ed, to);
+  _words_count(ed, *ws, *we, -1);
+}
+
+// puts back the words of [ws, we) once the edit is done
+static inline void words_add(Editor* ed, u32 ws, u32 we) { _words_count(ed, ws, we, 1); }
+
+// completes the word before cursor, or replaces the last completion by the next one
+static void complete_word(Editor* ed) {
+  struct complete* c = &ed->complete;
+  u32 curs = cursi(ed);
+  if (c->n > 0 && c->rev == ed->rev && c->curs == curs) {
+    c->i = (c->i + 1) % c->n;
+  } else {
+    c->start = _word_start(ed, curs);
+    c->plen = MIN(curs - c->start, TRIE_DEPTH);
+    if (c->plen == 0) {
+      set_status(ed, st_warn, "no word before cursor.");
+      return;
+    }
+    u32 prefix[TRIE_DEPTH];
+    for (u32 i = 0; i < c->plen; i++) {
+      prefix[i] = gap_get(&ed->buffer, c->start + i);
+    }
+    c->n = trie_top(&c->words, prefix, c->plen, c->nodes, COMPLETE_MAX);
+    c->i = 0;
+    if (c->n == 0) {
+      set_status(ed, st_warn, "no completions.");
+      return;
+    }
+  }
+  u32 word[TRIE_DEPTH];
+  u32 len = trie_word(&c->words, c->nodes[c->i], word);
+  editor_replace(ed, c->start, curs, word, len);
+  c->rev = ed->rev;
+  c->curs = cursi(ed);
+  set_status(ed, st_norm, "completion %u/%u, ctrl-n for the next.", c->i + 1, c->n);
+}
@@ -0,0 +1,444 @@
+#pragma once
+// resident editors served to the terminals of thin clients over a unix socket.
+// `laed -d` keeps every buffer it opened in memory, with its line index and undo history.
+// `laed -a file` connects, hands its terminal over along with the path and waits until
+// the editor is closed. the daemon drives that terminal through an ncurses screen of its
+// own, so reopening a buffer it keeps costs a redraw. a buffer is attached to one
+// terminal at a time, and buffers of files are kept even if they have unsaved changes.
+
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+
+#define DAEMON_SESSIONS 16 // terminals attached at once
+#define DAEMON_RESIDENT 32 // buffers kept, unmodified ones are dropped beyond this
+
+// first message of a client, sent along with its terminal
+struct daemon_hello {
+  enum modes mode;
+  char term[64];
+  char cwd[PATH_MAX];
+  char path[PATH_MAX]; // relative to cwd, empty for a scratch buffer
+};
+
+// later messages of a client
+struct daemon_resize {
+  u16 rows, cols;
+};
+
+// only message to a client, once its editor is closed
+struct daemon_reply {
+  i32 status;
+  char msg[STLEN];
+};
+
+struct session {
+  int sock; // -1 if unused
+  FILE* in;
+  FILE* out; // terminal of the client
+  SCREEN* screen;
+  WINDOW* win;
+  struct resident* r;
+  char cwd[PATH_MAX];
+};
+
+struct resident {
+  Editor* ed; // NULL if unused
+  char path[PATH_MAX]; // absolute path of its file, its bufname
+  struct session* session; // attached to, if any
+  u64 used; // detached at, in detaches of the daemon
+};
+
+struct daemon {
+  int listen;
+  struct session sessions[DAEMON_SESSIONS];
+  struct resident resident[DAEMON_RESIDENT];
+  u64 detaches;
+  SCREEN** retired; // screens of detached terminals, see _daemon_sweep
+  u32 nretired, retired_cap;
+};
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+static void _daemon_signal(int sig) { (void)sig; daemon_stop = 1; }
+
+// socket in the runtime directory of the user, or in /tmp if there is none
+static bool _daemon_addr(struct sockaddr_un* addr) {
+  *addr = (struct sockaddr_un){ .sun_family = AF_UNIX };
+  const char* dir = getenv("XDG_RUNTIME_DIR");
+  int n = (dir != NULL && *dir != '\0')
+    ? snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/laed.sock", dir)
+    : snprintf(addr->sun_path, sizeof(addr->sun_path), "/tmp/laed-%d.sock", (int)getuid());
+  return n < (int)sizeof(addr->sun_path);
+}
+
+static void _daemon_reply(int sock, i32 status, const char* msg) {
+  struct daemon_reply reply = { .status = status };
+  strncpy(reply.msg, msg, STLEN - 1);
+  send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+}
+
+// free slot for another buffer. drops the longest detached unmodified one if all are taken
+static struct resident* _daemon_slot(struct daemon* d) {
+  struct resident* oldest = NULL;
+  for (u32 i = 0; i < DAEMON_RESIDENT; i++) {
+    struct resident* r = &d->resident[i];
+    if (r->ed == NULL) return r;
+    if (r->session == NULL && !_has(r->ed->state, unwritten_buffer) && (oldest == NULL || r->used < oldest->used)) {
+      oldest = r;
+    }
+  }
+  if (oldest != NULL) {
+    editor_free(&oldest->ed);
+    *oldest = (struct resident){0};
+  }
+  return oldest;
+}
+
+// deletes the screens of detached terminals once none is attached. ncurses deletes the
+// windows of every screen along with any one of them, so until then they are kept
+static void _daemon_sweep(struct daemon* d) {
+  for (u32 i = 0; i < DAEMON_SESSIONS; i++) {
+    if (d->sessions[i].sock != -1) return;
+  }
+  for (u32 i = 0; i < d->nretired; i++) {
+    delscreen(d->retired[i]);
+  }
+  d->nretired = 0;
+}
+
+static void _daemon_retire(struct daemon* d, SCREEN* screen) {
+  if (d->nretired == d->retired_cap) {
+    u32 cap = MAX(d->retired_cap * 2, DAEMON_SESSIONS);
+    SCREEN** grown = mem_realloc(mem_misc, d->retired, sizeof(SCREEN*) * cap);
+    if (grown == NULL) return; // leaked rather than deleted under another terminal
+    d->retired = grown;
+    d->retired_cap = cap;
+  }
+  d->retired[d->nretired++] = screen;
+}
+
+static void _daemon_draw(struct session* s) {
+  set_term(s->screen);
+  editor_draw(s->win, s->r->ed);
+  wrefresh(s->win);
+}
+
+// gives the terminal back to the client and keeps its buffer, if it has a file
+static void _daemon_detach(struct daemon* d, struct session* s, i32 status, const char* msg) {
+  set_term(s->screen);
+  delwin(s->win);
+  endwin();
+  _daemon_retire(d, s->screen);
+  fclose(s->in);
+  fclose(s->out);
+  _daemon_reply(s->sock, status, msg);
+  close(s->sock);
+
+  struct resident* r = s->r;
+  if (*r->ed->bufname == '\0') { // scratch buffers are not kept
+    editor_free(&r->ed);
+    *r = (struct resident){0};
+  } else {
+    strncpy(r->path, r->ed->bufname, PATH_MAX - 1);
+    r->ed->ws->tty = -1;
+    r->session = NULL;
+    r->used = ++d->detaches;
+  }
+  *s = (struct session){ .sock = -1 };
+  _daemon_sweep(d);
+}
+
+// takes the terminal of a new client over and attaches a buffer to it
+static void _daemon_accept(struct daemon* d) {
+  int sock = accept4(d->listen, NULL, NULL, SOCK_CLOEXEC);
+  if (sock == -1) return;
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1 || cred.uid != getuid()) {
+    close(sock); // terminals of other users are never driven
+    return;
+  }
+
+  struct daemon_hello hello;
+  int fds[2] = { -1, -1 };
+  char control[CMSG_SPACE(sizeof(fds))];
+  struct iovec iov = { &hello, sizeof(hello) };
+  struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control) };
+  ssize_t got = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  }
+  struct session* s = NULL;
+  for (u32 i = 0; i < DAEMON_SESSIONS && s == NULL; i++) {
+    if (d->sessions[i].sock == -1) s = &d->sessions[i];
+  }
+  hello.term[sizeof(hello.term) - 1] = hello.cwd[PATH_MAX - 1] = hello.path[PATH_MAX - 1] = '\0';
+  const char* err = NULL;
+  if (got != sizeof(hello) || fds[0] == -1) {
+    err = "malformed request.";
+  } else if (s == NULL) {
+    err = "too many terminals attached.";
+  } else if (chdir(hello.cwd) == -1) {
+    err = strerror(errno);
+  }
+
+  struct resident* r = NULL;
+  char key[PATH_MAX] = "";
+  if (err == NULL && *hello.path != '\0') {
+    abs_path(hello.path, key);
+    for (u32 i = 0; i < DAEMON_RESIDENT && r == NULL; i++) {
+      if (d->resident[i].ed != NULL && strcmp(d->resident[i].path, key) == 0) r = &d->resident[i];
+    }
+    if (r != NULL && r->session != NULL) err = "file is attached to another terminal.";
+  }
+  if (err == NULL && r == NULL && (r = _daemon_slot(d)) == NULL) {
+    err = "every kept buffer has unsaved changes.";
+  }
+  if (err == NULL) {
+    s->in = fdopen(fds[0], "r");
+    s->out = fdopen(fds[1], "w");
+    s->screen = s->in && s->out ? newterm(*hello.term ? hello.term : NULL, s->out, s->in) : NULL;
+    if (s->screen == NULL) err = "failed to set up terminal.";
+  }
+  if (err != NULL) {
+    if (s != NULL && s->in != NULL) fclose(s->in); else if (fds[0] != -1) close(fds[0]);
+    if (s != NULL && s->out != NULL) fclose(s->out); else if (fds[1] != -1) close(fds[1]);
+    if (s != NULL) *s = (struct session){ .sock = -1 };
+    _daemon_reply(sock, EXIT_FAILURE, err);
+    close(sock);
+    return;
+  }
+
+  s->sock = sock;
+  s->win = term_init();
+  s->r = r;
+  strncpy(s->cwd, hello.cwd, PATH_MAX - 1);
+  if (r->ed == NULL) { // not kept yet
+    r->ed = editor_init(*hello.path ? hello.path : NULL, hello.mode, true);
+    strncpy(r->path, r->ed->bufname, PATH_MAX - 1);
+  } else {
+    _reset(&r->ed->state, quit);
+    r->ed->drawn.valid = false; // window of its last terminal is gone
+    set_status(r->ed, st_norm, "attached %s", r->ed->bufname);
+  }
+  r->session = s;
+  r->ed->ws->tty = fileno(s->in);
+  if (getcwd(s->cwd, PATH_MAX) == NULL) { // opening a directory moves into it
+    strncpy(s->cwd, hello.cwd, PATH_MAX - 1);
+  }
+  _daemon_draw(s);
+}
+
+// handles the keys a terminal has sent so far
+static void _daemon_input(struct daemon* d, struct session* s) {
+  Editor* ed = s->r->ed;
+  if (chdir(s->cwd) == -1) return;
+  set_term(s->screen);
+  wtimeout(s->win, 0);
+  u32 ch;
+  while (!_has(ed->state, quit) && wget_wch(s->win, &ch) != ERR) {
+    editor_input(ed, ch);
+  }
+  if (_has(ed->state, quit)) {
+    _daemon_detach(d, s, EXIT_SUCCESS, "");
+    return;
+  }
+  if (getcwd(s->cwd, PATH_MAX) == NULL) *s->cwd = '\0';
+  if (strcmp(ed->bufname, s->r->path) != 0) { // another file was opened from palette
+    strncpy(s->r->path, ed->bufname, PATH_MAX - 1);
+  }
+  editor_tick(ed);
+  _daemon_draw(s);
+}
+
+// window size of the client terminal changed
+static void _daemon_resize(struct daemon* d, struct session* s) {
+  struct daemon_resize size;
+  ssize_t got = recv(s->sock, &size, sizeof(size), MSG_DONTWAIT);
+  if (got == -1 && (errno == EAGAIN || errno == EINTR)) return;
+  if (got != sizeof(size)) { // client is gone
+    _daemon_detach(d, s, EXIT_FAILURE, "");
+    return;
+  }
+  set_term(s->screen);
+  resize_term(size.rows, size.cols);
+  wresize(s->win, size.rows, size.cols);
+  clearok(s->win, TRUE);
+  _daemon_draw(s);
+}
+
+static void _daemon_loop(struct daemon* d) {
+  struct pollfd fds[2 + DAEMON_SESSIONS * 2 + DAEMON_RESIDENT];
+  struct session* owner[2 + DAEMON_SESSIONS * 2 + DAEMON_RESIDENT];
+  while (!daemon_stop) {
+    u32 n = 0;
+    fds[n++] = (struct pollfd){ .fd = d->listen, .events = POLLIN };
+    i32 timeout = -1;
+    for (u32 i = 0; i < DAEMON_SESSIONS; i++) {
+      struct session* s = &d->sessions[i];
+      if (s->sock == -1) continue;
+      owner[n] = s;
+      fds[n++] = (struct pollfd){ .fd = s->sock, .events = POLLIN };
+      owner[n] = s;
+      fds[n++] = (struct pollfd){ .fd = fileno(s->in), .events = POLLIN };
+    }
+    u32 sessions = n;
+    fds[n++] = (struct pollfd){ .fd = wake_fd, .events = POLLIN };
+    for (u32 i = 0; i < DAEMON_RESIDENT; i++) {
+      if (d->resident[i].ed == NULL) continue;
+      i32 interval = editor_poll_interval(d->resident[i].ed);
+      if (interval >= 0 && (timeout == -1 || interval < timeout)) timeout = interval;
+      int watch = editor_watch_fd(d->resident[i].ed);
+      if (watch != -1) fds[n++] = (struct pollfd){ .fd = watch, .events = POLLIN };
+    }
+    if (poll(fds, n, timeout) == -1 && errno != EINTR) {
+      perror("poll");
+      return;
+    }
+    if (fds[sessions].revents & POLLIN) wake_drain();
+    if (fds[0].revents & POLLIN) _daemon_accept(d);
+    for (u32 i = 1; i < sessions; i += 2) {
+      struct session* s = owner[i];
+      if (s->sock != fds[i].fd) continue; // detached while accepting
+      if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        _daemon_resize(d, s);
+      } else if (fds[i + 1].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+        _daemon_detach(d, s, EXIT_FAILURE, "terminal hung up.");
+      } else if (fds[i + 1].revents & POLLIN) {
+        _daemon_input(d, s);
+      }
+    }
+    for (u32 i = 0; i < DAEMON_RESIDENT; i++) { // background work goes on for detached buffers too
+      struct resident* r = &d->resident[i];
+      if (r->ed != NULL && editor_tick(r->ed) && r->session != NULL) {
+        _daemon_draw(r->session);
+      }
+    }
+  }
+}
+
+static i32 daemon_run(void) {
+  setlocale(LC_ALL, "");
+  struct daemon d = { .listen = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0) };
+  for (u32 i = 0; i < DAEMON_SESSIONS; i++) {
+    d.sessions[i].sock = -1;
+  }
+  struct sockaddr_un addr;
+  if (d.listen == -1 || !_daemon_addr(&addr)) {
+    perror("daemon socket");
+    return EXIT_FAILURE;
+  }
+  if (connect(d.listen, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+    fprintf(stderr, "daemon is already running on %s\n", addr.sun_path);
+    return EXIT_FAILURE;
+  }
+  close(d.listen);
+  d.listen = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  unlink(addr.sun_path); // left over by a daemon that did not stop cleanly
+  mode_t mask = umask(0077);
+  if (d.listen == -1 || bind(d.listen, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(d.listen, 8) == -1) {
+    perror(addr.sun_path);
+    return EXIT_FAILURE;
+  }
+  umask(mask);
+
+  struct sigaction sa = { .sa_handler = _daemon_signal };
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+  fprintf(stderr, "serving on %s\n", addr.sun_path);
+  _daemon_loop(&d);
+
+  for (u32 i = 0; i < DAEMON_SESSIONS; i++) {
+    if (d.sessions[i].sock != -1) _daemon_detach(&d, &d.sessions[i], EXIT_FAILURE, "daemon stopped.");
+  }
+  for (u32 i = 0; i < DAEMON_RESIDENT; i++) {
+    if (d.resident[i].ed != NULL) editor_free(&d.resident[i].ed);
+  }
+  mem_free(mem_misc, d.retired);
+  close(d.listen);
+  unlink(addr.sun_path);
+  return EXIT_SUCCESS;
+}
+
+static volatile sig_atomic_t client_winch = 0;
+
+static void _client_signal(int sig) { (void)sig; client_winch = 1; }
+
+// attaches this terminal to path in the daemon and waits until the editor is closed.
+// returns the exit status, or -1 if there is no daemon to attach to
+static i32 client_run(const char* path, enum modes mode) {
+  struct sockaddr_un addr;
+  int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (sock == -1 || !_daemon_addr(&addr) || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    if (sock != -1) close(sock);
+    return -1;
+  }
+  struct daemon_hello hello = { .mode = mode };
+  const char* term = getenv("TERM");
+  strncpy(hello.term, term != NULL ? term : "", sizeof(hello.term) - 1);
+  if (getcwd(hello.cwd, PATH_MAX) == NULL || (path != NULL && strlen(path) >= PATH_MAX)) {
+    fprintf(stderr, "path is too long to attach.\n");
+    close(sock);
+    return EXIT_FAILURE;
+  }
+  strncpy(hello.path, path != NULL ? path : "", PATH_MAX - 1);
+
+  int fds[2] = { STDIN_FILENO, STDOUT_FILENO };
+  char control[CMSG_SPACE(sizeof(fds))] = {0};
+  struct iovec iov = { &hello, sizeof(hello) };
+  struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control) };
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  struct termios saved;
+  bool tty = tcgetattr(STDIN_FILENO, &saved) == 0;
+  struct sigaction sa = { .sa_handler = _client_signal }; // no SA_RESTART, poll returns on resize
+  sigaction(SIGWINCH, &sa, NULL);
+  if (sendmsg(sock, &msg, MSG_NOSIGNAL) != sizeof(hello)) {
+    perror("attach");
+    close(sock);
+    return EXIT_FAILURE;
+  }
+
+  struct daemon_reply reply = { .status = EXIT_FAILURE };
+  while (1) {
+    struct pollfd pfd = { .fd = sock, .events = POLLIN };
+    if (client_winch) {
+      client_winch = 0;
+      struct winsize ws;
+      if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0) {
+        struct daemon_resize size = { ws.ws_row, ws.ws_col };
+        send(sock, &size, sizeof(size), MSG_NOSIGNAL);
+      }
+    }
+    if (poll(&pfd, 1, -1) == -1) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    ssize_t got = recv(sock, &reply, sizeof(reply), 0);
+    if (got == -1 && errno == EINTR) continue;
+    if (got != sizeof(reply)) {
+      reply = (struct daemon_reply){ EXIT_FAILURE, "daemon went away." };
+    }
+    break;
+  }
+  close(sock);
+  if (tty) {
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+  }
+  reply.msg[STLEN - 1] = '\0';
+  if (*reply.msg != '\0') {
+    fprintf(stderr, "%s\n", reply.msg);
+  }
+  return reply.status;
+}
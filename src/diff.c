@@ -0,0 +1,325 @@
+#pragma once
+// markers in the gutter for lines that differ from the file on disk.
+// lines are compared by hash and diffed with the linear space variant of Myers' algorithm.
+// every buffer line remembers the file line it is kept as, so an edit only marks its
+// lines dirty; the next update diffs again just between the closest kept lines around
+// them instead of the whole file.
+
+#define DIFF_MAX_COST 2048 // edit distance searched before a region is taken as changed
+#define DIFF_HASH_SEED 0xcbf29ce484222325ULL
+#define DIFF_HASH_PRIME 0x100000001b3ULL
+
+struct diff_run {
+  const u64* a; // buffer line hashes
+  const u64* b; // file line hashes
+  i32* map;
+  i32* v; // furthest reaching paths, forward and backward
+};
+
+static u32* _read_disk_text(Editor* ed, u32* len, off_t* size, enum eol* eol);
+static inline void load_finish(Editor* ed);
+
+static inline u64 _diff_hash_step(u64 h, u32 ch) { return (h ^ ch) * DIFF_HASH_PRIME; }
+
+// hashes lines of text into out, continuing the hash h of a line started by a previous call
+static void _diff_hash_lines(const u32* text, u32 n, u64* out, u32* line, u64* h) {
+  for (u32 i = 0; i < n; i++) {
+    if (text[i] == '\n') {
+      out[(*line)++] = *h;
+      *h = DIFF_HASH_SEED;
+    } else {
+      *h = _diff_hash_step(*h, text[i]);
+    }
+  }
+}
+
+static u64 _diff_line_hash(Editor* ed, u32 lno) {
+  u64 h = DIFF_HASH_SEED;
+  for (u32 i = lnbeg(ed, lno), end = lnend(ed, lno); i < end; i++) {
+    h = _diff_hash_step(h, gap_get(&ed->buffer, i));
+  }
+  return h;
+}
+
+static void diff_stop(struct diff* d) {
+  mem_free(mem_diff, d->disk);
+  mem_free(mem_diff, d->hash);
+  mem_free(mem_diff, d->map);
+  mem_free(mem_diff, d->marks);
+  *d = (struct diff){0};
+}
+
+// makes room for n buffer lines
+static void _diff_fit(struct diff* d, u32 n) {
+  if (n <= d->cap) return;
+  u32 cap = MAX(n, d->cap + d->cap / 2);
+  u64* hash = mem_realloc(mem_diff, d->hash, sizeof(u64) * cap);
+  if (hash != NULL) d->hash = hash;
+  i32* map = mem_realloc(mem_diff, d->map, sizeof(i32) * cap);
+  if (map != NULL) d->map = map;
+  u8* marks = mem_realloc(mem_diff, d->marks, cap);
+  if (marks != NULL) d->marks = marks;
+  if (hash == NULL || map == NULL || marks == NULL) {
+    perror("failed to grow diff");
+    exit(-1);
+  }
+  d->cap = cap;
+}
+
+// finds the middle snake of the shortest edit script between a[a0, a1) and b[b0, b1),
+// both with no common prefix or suffix. returns false if it costs more than DIFF_MAX_COST
+static bool _diff_bisect(struct diff_run* r, u32 a0, u32 a1, u32 b0, u32 b1, u32* x, u32* y) {
+  const u64* a = r->a + a0;
+  const u64* b = r->b + b0;
+  i32 n = a1 - a0, m = b1 - b0;
+  i32 lim = MIN((n + m + 1) / 2, DIFF_MAX_COST);
+  i32 off = lim, len = 2 * lim;
+  i32* v1 = r->v;
+  i32* v2 = r->v + len + 2;
+  for (i32 i = 0; i < len + 2; i++) {
+    v1[i] = v2[i] = -1;
+  }
+  v1[off + 1] = v2[off + 1] = 0;
+  i32 delta = n - m;
+  bool front = delta & 1; // paths meet while going forward if delta is odd
+  i32 k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+  for (i32 d = 0; d < lim; d++) {
+    for (i32 k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+      i32 k1o = off + k1;
+      i32 x1 = (k1 == -d || (k1 != d && v1[k1o - 1] < v1[k1o + 1])) ? v1[k1o + 1] : v1[k1o - 1] + 1;
+      i32 y1 = x1 - k1;
+      while (x1 < n && y1 < m && a[x1] == b[y1]) {
+        x1++;
+        y1++;
+      }
+      v1[k1o] = x1;
+      if (x1 > n) {
+        k1end += 2;
+      } else if (y1 > m) {
+        k1start += 2;
+      } else if (front) {
+        i32 k2o = off + delta - k1;
+        if (k2o >= 0 && k2o < len && v2[k2o] != -1 && x1 >= n - v2[k2o]) {
+          *x = a0 + x1;
+          *y = b0 + y1;
+          return true;
+        }
+      }
+    }
+    for (i32 k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+      i32 k2o = off + k2;
+      i32 x2 = (k2 == -d || (k2 != d && v2[k2o - 1] < v2[k2o + 1])) ? v2[k2o + 1] : v2[k2o - 1] + 1;
+      i32 y2 = x2 - k2;
+      while (x2 < n && y2 < m && a[n - x2 - 1] == b[m - y2 - 1]) {
+        x2++;
+        y2++;
+      }
+      v2[k2o] = x2;
+      if (x2 > n) {
+        k2end += 2;
+      } else if (y2 > m) {
+        k2start += 2;
+      } else if (!front) {
+        i32 k1o = off + delta - k2;
+        if (k1o >= 0 && k1o < len && v1[k1o] != -1 && v1[k1o] >= n - x2) {
+          *x = a0 + v1[k1o];
+          *y = b0 + v1[k1o] - (k1o - off);
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// maps lines of a[a0, a1) to the lines of b[b0, b1) they are kept as
+static void _diff_region(struct diff_run* r, u32 a0, u32 a1, u32 b0, u32 b1) {
+  while (a0 < a1 && b0 < b1 && r->a[a0] == r->b[b0]) {
+    r->map[a0++] = b0++;
+  }
+  while (a0 < a1 && b0 < b1 && r->a[a1 - 1] == r->b[b1 - 1]) {
+    r->map[--a1] = --b1;
+  }
+  u32 x, y;
+  if (a0 < a1 && b0 < b1 && _diff_bisect(r, a0, a1, b0, b1, &x, &y)) {
+    _diff_region(r, a0, x, b0, y);
+    _diff_region(r, x, a1, y, b1);
+    return;
+  }
+  for (u32 i = a0; i < a1; i++) { // nothing in common, or too expensive to find out
+    r->map[i] = -1;
+  }
+}
+
+// recomputes markers of buffer lines [a, b]. lines a - 1 and b (if any) have to be kept lines
+static void _diff_mark(struct diff* d, u32 a, u32 b) {
+  memset(d->marks + a, 0, b - a);
+  if (b < d->nlines) {
+    d->marks[b] &= ~diff_removed;
+  } else if (d->nlines > 0) {
+    d->marks[d->nlines - 1] &= ~diff_removed_end;
+  }
+  i32 prev = a > 0 ? d->map[a - 1] : -1;
+  for (u32 i = a; ; ) {
+    u32 j = i;
+    while (j < b && d->map[j] == -1) j++;
+    i32 next = j < d->nlines ? d->map[j] : (i32)d->ndisk;
+    u32 gone = next - prev - 1, run = j - i; // file lines replaced by the run of lines
+    for (u32 k = 0; k < run; k++) {
+      d->marks[i + k] = k < gone ? diff_changed : diff_added;
+    }
+    if (gone > run) {
+      if (j < d->nlines) {
+        d->marks[j] |= diff_removed;
+      } else if (d->nlines > 0) {
+        d->marks[d->nlines - 1] |= diff_removed_end;
+      }
+    }
+    if (j >= b) break;
+    prev = d->map[j];
+    i = j + 1;
+  }
+}
+
+// diffs buffer lines [a, b) against file lines [da, db)
+static void _diff_run(struct diff* d, u32 a, u32 b, u32 da, u32 db) {
+  i32* v = mem_alloc(mem_diff, sizeof(i32) * (DIFF_MAX_COST + 1) * 4);
+  if (v == NULL) {
+    perror("diff");
+    exit(-1);
+  }
+  struct diff_run r = { d->hash, d->disk, d->map, v };
+  _diff_region(&r, a, b, da, db);
+  mem_free(mem_diff, v);
+  _diff_mark(d, a, b);
+}
+
+// reads the file again and diffs the whole buffer against it
+static void diff_load(Editor* ed) {
+  struct diff* d = &ed->diff;
+  u32 len = 0;
+  off_t size;
+  enum eol eol;
+  errno = 0;
+  u32* text = _read_disk_text(ed, &len, &size, &eol);
+  if (text == NULL && errno != ENOENT) { // a file not created yet has no lines to keep
+    set_status(ed, st_warn, "diff: %s", strerror(errno));
+    diff_stop(d);
+    return;
+  }
+  u32 lines = 1;
+  for (u32 i = 0; i < len; i++) {
+    lines += text[i] == '\n';
+  }
+  u64* disk = mem_realloc(mem_diff, d->disk, sizeof(u64) * lines);
+  if (disk == NULL) {
+    perror("diff");
+    exit(-1);
+  }
+  d->disk = disk;
+  d->ndisk = 0;
+  u64 h = DIFF_HASH_SEED;
+  _diff_hash_lines(text, len, d->disk, &d->ndisk, &h);
+  d->disk[d->ndisk++] = h;
+  mem_free(mem_io, text);
+
+  GapBuffer* gap = &ed->buffer;
+  _diff_fit(d, lncount(ed));
+  d->nlines = 0;
+  h = DIFF_HASH_SEED;
+  _diff_hash_lines(gap->start, gap->c, d->hash, &d->nlines, &h);
+  _diff_hash_lines(gap->start + gap->ce + 1, gap->end - gap->ce, d->hash, &d->nlines, &h);
+  d->hash[d->nlines++] = h;
+  _diff_run(d, 0, d->nlines, 0, d->ndisk);
+  d->reload = false;
+  d->lo = d->hi = 0;
+}
+
+// the file changed on disk, it is read again by the next update
+static inline void diff_invalidate(struct diff* d) { d->reload = d->on; }
+
+// moves a boundary between two lines across an edit of diff_edit
+static inline u32 _diff_shift(u32 x, u32 line, u32 removed, u32 added) {
+  if (x <= line + 1) return x;
+  if (x <= line + 1 + removed) return line + 1 + added;
+  return x + added - removed;
+}
+
+// line was edited: `removed` lines after it were joined into it and `added` new lines
+// follow it now. marks them dirty for the next update
+static void diff_edit(struct diff* d, u32 line, u32 removed, u32 added) {
+  if (!d->on) return;
+  if (added != removed) {
+    u32 n = d->nlines + added - removed;
+    _diff_fit(d, n);
+    u32 from = line + 1 + removed, to = line + 1 + added, tail = d->nlines - from;
+    memmove(d->hash + to, d->hash + from, sizeof(u64) * tail);
+    memmove(d->map + to, d->map + from, sizeof(i32) * tail);
+    memmove(d->marks + to, d->marks + from, tail);
+    d->nlines = n;
+  }
+  for (u32 i = line; i < line + 1 + added; i++) {
+    d->map[i] = -1;
+  }
+  if (d->lo < d->hi) {
+    d->lo = MIN(_diff_shift(d->lo, line, removed, added), line);
+    d->hi = MAX(_diff_shift(d->hi, line, removed, added), line + 1 + added);
+  } else {
+    d->lo = line;
+    d->hi = line + 1 + added;
+  }
+}
+
+// brings markers up to date with the edits made since last update
+static void diff_update(Editor* ed) {
+  struct diff* d = &ed->diff;
+  if (!d->on) return;
+  if (d->reload) {
+    diff_load(ed);
+    return;
+  }
+  if (d->lo >= d->hi) return;
+  for (u32 i = d->lo; i < d->hi; i++) {
+    d->hash[i] = _diff_line_hash(ed, i);
+  }
+  u32 a = d->lo, b = d->hi; // widened to the closest kept lines around
+  while (a > 0 && d->map[a - 1] == -1) a--;
+  while (b < d->nlines && d->map[b] == -1) b++;
+  u32 da = a > 0 ? d->map[a - 1] + 1 : 0;
+  u32 db = b < d->nlines ? (u32)d->map[b] : d->ndisk;
+  _diff_run(d, a, b, da, db);
+  d->lo = d->hi = 0;
+}
+
+static void diff_toggle(Editor* ed) {
+  struct diff* d = &ed->diff;
+  if (d->on) {
+    diff_stop(d);
+    set_status(ed, st_norm, "diff off.");
+    return;
+  }
+  if (ed->mode != mode_edit || *ed->bufname == '\0') {
+    set_status(ed, st_warn, "nothing to compare, buffer has no file.");
+    return;
+  }
+  load_finish(ed); // lines are compared against the whole file
+  d->on = true;
+  diff_load(ed);
+  if (d->on) {
+    set_status(ed, st_norm, "diff against %s.", ed->bufname);
+  }
+}
+
+// draws the marker of line into the gutter at row vy
+static void diff_draw(WINDOW* edwin, Editor* ed, u16 vy, u32 line) {
+  struct diff* d = &ed->diff;
+  if (!d->on || line >= d->nlines || d->marks[line] == 0) return;
+  u8 mark = d->marks[line];
+  chtype ch = '-' | COLOR_PAIR(TXT_RED);
+  if (mark & diff_added) {
+    ch = '+' | COLOR_PAIR(TXT_GREEN);
+  } else if (mark & diff_changed) {
+    ch = '~' | COLOR_PAIR(TXT_ORANGE);
+  }
+  mvwaddch(edwin, vy, LNO_PADDING - 1, ch | A_BOLD);
+}
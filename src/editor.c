@@ -5,6 +5,9 @@
 #ifndef _XOPEN_SOURCE_EXTENDED
 #define _XOPEN_SOURCE_EXTENDED
 #endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE // d_type of directory entries
+#endif
 
 #include <ctype.h>
 #include <stdlib.h>
@@ -12,14 +15,29 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <ncursesw/ncurses.h>
 #include <wchar.h> // for utf-8 helper functions
+#include <wctype.h> // for iswalnum
 
 #include "colors.c"
 #include "include/utils.h"
 #include "include/itypes.h"
 #include "include/gap.h"
 #include "include/u32Da.h"
+#include "include/utf8.h"
+#include "include/width.h"
+#include "include/lf.h"
+#include "include/fold.h"
+#include "include/wrap.h"
+#include "include/trie.h"
+#include "include/anchor.h"
+#include "include/synced.h"
+#include "include/pool.h"
+#include "include/wake.h"
 
 #define SCROLL_BOUNDRY 6
 #define TAB_STOPS 4
@@ -38,9 +56,15 @@ enum timeline_op { op_idle = 0, op_ins = 1, op_del = -1 };
 #define LNO_PADDING 7
 #define PAIR_STK_SIZE 16
 
+#define SAVE_CHUNK KB(16) // code points encoded per write by the save worker
+#define SAVE_POINT KB(256) // code points between save points left by the save worker
+
+#define FINDER_TOP 32 // best matches kept per finder query
+
 struct action {
   enum timeline_op op;
   u32 start;
+  u32 group; // consecutive actions of the same nonzero group are undone together
   u32Da frame;
 };
 
@@ -50,6 +74,9 @@ struct timeline {
   struct action redo[UNDO_LIMIT];
   isize utop;
   isize rtop;
+  u32 groups; // last issued group id
+  u32 group; // group of newly recorded actions, 0 if none is open
+  struct mem_blocks frames; // first storage of every action frame
 };
 
 enum states {
@@ -60,6 +87,10 @@ enum states {
   pairing = 0x10, // to handle pairing characters
   lock_modify = 0x20, // prevent the editor from inserting characters by itself
   unwritten_buffer = 0x40, // contents inside buffer has to be written to file
+  saving = 0x80, // a snapshot of the buffer is being written by the save worker
+  stale = 0x100, // file changed on disk while buffer had unwritten changes
+  quit = 0x200, // editor was closed, its main loop ends
+  replaying = 0x400, // keys of a macro are replayed, edits are recorded once it ends
 };
 
 enum status_msg_type {
@@ -73,18 +104,297 @@ struct status {
   char msg[STLEN];
 };
 
+// what editor_draw left in its window. if only the view moved vertically since, the rows
+// still shown are scrolled into place and just the exposed ones are painted
+struct drawn {
+  bool valid;
+  u16 h, w;
+  u32 y, x; // view
+  u64 rev;
+  u32 len, lines; // of buffer, appends do not change rev
+  u32 folds; // revision of folds
+  u32 marked[3]; // lines carrying the cursor and bracket highlights
+};
+
+// background save of a frozen buffer snapshot.
+// the worker reads the gap segments of `frozen` directly. the editor keeps using the
+// same memory until it is about to change it, then moves to a private copy (detached).
+struct save_job {
+  pthread_t thread;
+  atomic_bool done;
+  u32* frozen; // gap buffer storage at the time of snapshot
+  u32 c, ce, end; // segment bounds of frozen
+  bool detached; // editor owns a copy, frozen has to be freed after the job
+  u64 rev; // buffer revision captured by the snapshot
+  int fd;
+  int err; // errno reported by the worker
+  u32 len; // characters in the snapshot
+  off_t size; // bytes in the file after the save
+  enum eol eol; // line ending written for '\n'
+  struct save_point from; // where writing starts, the file already holds what is before
+  struct save_point* points; // left every SAVE_POINT characters written, see include/synced.h
+  u32 npoints;
+};
+
+enum modes {
+  mode_edit = 0, // editing text decoded into buffer
+  mode_view, // read-only view of a memory mapped file
+  mode_hex, // bytes of a memory mapped file, overwritten in place
+};
+
+// read-only view of a file too large to be decoded into buffer. the file is mapped a
+// window at a time and lines are located through a sparse index built in background.
+struct viewer {
+  int fd;
+  u64 size;
+  byte* map; // currently mapped window of the file
+  u64 map_off, map_len;
+  pthread_t indexer;
+  pthread_mutex_t lock; // guards marks
+  u64* marks; // byte offset of every VIEWER_MARK_STRIDE-th line
+  u64 nmarks, cap;
+  atomic_ullong newlines; // newlines found by the indexer so far
+  atomic_ullong scanned; // bytes indexed so far
+  atomic_bool stop;
+  u64 reported; // scanned bytes at last redraw
+  u64 hint_line, hint_off; // last located line, saves rescans while scrolling
+  u32 curs; // cursor line
+  u32 col; // visual column of cursor
+};
+
+struct hex_patch {
+  u64 off;
+  byte val;
+};
+
+// hex view of a mapped file. bytes typed over it are kept as patches until saved
+struct hex {
+  int fd; // -1 if not in hex mode
+  bool writable;
+  u64 size;
+  const byte* map; // the whole file, NULL if it is empty
+  struct hex_patch* patches; // sorted by offset
+  u32 npatches, cap;
+  u64 curs; // byte offset of cursor
+  u64 top; // first row on screen
+  u32 per; // bytes per row
+  bool low; // next digit goes to the low half of the byte
+  bool text; // cursor is in the text column
+};
+
+struct watch {
+  int fd; // inotify instance watching the directory of the file. -1 if none
+  char name[STLEN]; // name of the file inside the watched directory
+  bool pending; // events arrived which are not reconciled yet
+  struct timespec last_event;
+  struct stat disk; // state of the file buffer was last synced with
+  off_t offset; // bytes of the file that buffer reflects
+  bool follow; // append bytes written to the end of the file (tail -f)
+  bool behind; // follow mode has more bytes to ingest
+};
+
+// chunk of the file decoded by the loader, see load.c
+struct load_chunk {
+  struct load_chunk* next;
+  u32 n; // code points in text
+  u32 bytes; // bytes of the file they were decoded from
+  u32* starts; // offset in text after each newline
+  u32 nstarts;
+  bool to_lf; // first chunk decoded as lf after crlf ones, see buffer_to_lf
+  u32 text[];
+};
+
+struct load {
+  bool active; // worker is running or its chunks are not all in buffer yet
+  pthread_t thread;
+  pthread_mutex_t lock; // guards the queue and done
+  pthread_cond_t cond; // signaled when a chunk is queued or taken, and when the worker ends
+  struct load_chunk* head; // decoded chunks waiting to be appended
+  struct load_chunk* tail;
+  u32 queued;
+  bool done;
+  atomic_bool stop;
+  int fd;
+  int err; // errno reported by the worker
+  Pool* pool;
+  u64 size; // bytes of the file
+  u64 offset; // bytes of the file in buffer
+  atomic_ullong newlines; // in the bytes decoded so far
+  atomic_ullong decoded; // bytes of the file decoded, appended to buffer or queued
+  atomic_bool counted; // newlines are those of the whole file
+  enum eol eol; // detected line ending, written by the worker while it runs
+};
+
+// depth summary of a block of bracket index storage, see bracket.c
+struct bracket_block {
+  i32 sum; // net depth change. opening brackets count +1
+  i32 min_pre; // lowest depth reached walking the block forward
+  i32 min_suf; // lowest depth reached walking it backward, signs inverted
+  bool dirty;
+};
+
+struct brackets {
+  GapBuffer at; // (position << 1) | closing, sorted by position
+  u32 delta; // added to positions of entries after the gap
+  struct bracket_block* blocks;
+  u32 nblocks;
+};
+
+enum diff_mark {
+  diff_added = 0x1, // line is not in the file
+  diff_changed = 0x2, // line replaces a line of the file
+  diff_removed = 0x4, // lines of the file were removed before this line
+  diff_removed_end = 0x8, // lines of the file were removed after this last line
+};
+
+// buffer compared line by line with its file on disk
+struct diff {
+  bool on;
+  bool reload; // file changed, has to be read again
+  u64* disk; // hash of every file line
+  u32 ndisk;
+  u64* hash; // hash of every buffer line
+  i32* map; // file line each buffer line is kept as, -1 if added or changed
+  u8* marks; // enum diff_mark of every buffer line
+  u32 nlines, cap;
+  u32 lo, hi; // buffer lines edited since last update, none if lo >= hi
+};
+
+// paths below the working directory. walker tasks on the pool hand their findings over
+// through `found`; the cached list itself is only touched by the main thread.
+struct finder {
+  Pool* pool;
+  int root; // fd of the working directory
+  atomic_uint walking; // directory tasks queued or running
+  atomic_bool cancel;
+  pthread_mutex_t lock; // guards found
+  char* found; // nul separated paths not merged yet
+  usize found_len, found_cap;
+  char* names; // nul separated cached paths
+  usize names_len, names_cap;
+  u32* offs; // start of each path inside names
+  u32* masks; // characters present in each path, see path_mask
+  u32 count, cap;
+};
+
+// best matches of a finder query, by descending score
+struct finder_top {
+  u32 idx[FINDER_TOP];
+  i32 score[FINDER_TOP];
+  u32 n;
+};
+
+// line of a file containing the pattern of a project grep
+struct grep_hit {
+  u32 path; // offsets into grep.text
+  u32 line;
+  u32 text;
+};
+
+// project wide search over the files of the finder. files are searched in batches by
+// tasks on the pool, which stream their hits through `incoming` to the main thread.
+struct grep {
+  char pattern[STLEN];
+  usize plen;
+  atomic_uint gen; // bumped by every new search, tasks of older ones give up
+  atomic_uint running; // batches queued or running
+  atomic_uint scanned; // files searched
+  atomic_uint found; // hits found, searching stops at GREP_MAX_HITS
+  u32 next; // next file of the finder list to hand out
+  pthread_mutex_t lock; // guards incoming
+  char* incoming; // hits not merged yet: u32 line, path, text
+  usize incoming_len, incoming_cap;
+  struct grep_hit* hits; // merged hits, touched by the main thread only
+  u32 nhits, cap;
+  char* text; // paths and lines of hits
+  usize text_len, text_cap;
+  bool active;
+};
+
+enum palette_view {
+  view_query = 0, // files or commands matching the query
+  view_grep, // hits of the last grep
+};
+
+struct palette {
+  bool open;
+  enum palette_view view;
+  char query[STLEN]; // utf-8
+  u32 len;
+  struct finder_top files;
+  u32 cmds[FINDER_TOP]; // matching commands, when query starts with '>'
+  u32 ncmds;
+  u32 sel; // selected row
+  u32 scored; // number of paths the files were picked from
+};
+
+#define COMPLETE_MAX 16 // candidates offered per completion
+
+// completion last inserted, cycled through while nothing else happens
+struct complete {
+  struct trie words; // every word of buffer
+  u64 rev; // of buffer after the completion
+  u32 curs, start, plen; // cursor after it, start of the word and its completed prefix
+  u32 nodes[COMPLETE_MAX]; // candidates found for prefix
+  u32 n, i;
+};
+
+#define MARK_NAMES 26 // a-z
+
+enum mark_wait { mark_none, mark_set, mark_jump }; // what the next key names a mark for
+
+struct marks {
+  u32 id[MARK_NAMES]; // anchor of each mark, ANCHOR_NONE if unset
+  enum mark_wait wait;
+};
+
+struct macro {
+  u32Da keys; // handed to editor_key in the order they were typed
+  bool recording;
+  struct macro_run* run; // replay in progress, NULL if none
+};
+
+// state that outlives the buffer, like when another file is opened from the palette
+struct workspace {
+  Pool* pool;
+  struct finder finder;
+  struct grep grep;
+  struct palette palette;
+  struct macro macro;
+  int tty; // terminal the keys come in from, -1 while a resident buffer is detached
+};
+
 typedef struct {
   enum states state;
+  enum modes mode;
   GapBuffer buffer;
-  struct { u32 x; u32 y; } view; // this is visual indices. not logical
+  struct { u32 x; u32 y; u32 sub; } view; // this is visual indices. not logical. wrapped, line y shows from its row sub
   GapBuffer lines;
   isize line_delta;
+  struct folds folds;
+  struct wrap wrap; // rows of lines when soft wrapped
+  struct anchors anchors; // positions that follow edits
+  struct marks marks;
+  struct brackets brackets;
+  struct diff diff;
+  struct complete complete;
+  u64 rev; // incremented on every modification of buffer
+  struct synced synced; // prefix of buffer the file still holds
+  enum eol eol; // line ending of the file. buffer itself only holds '\n'
   struct timeline tl;
   u32 sticky_curs;
   u32Da pair_stack;
   FILE* fp;
-  char bufname[STLEN];
+  char bufname[PATH_MAX]; // path of the file, absolute if resident
   struct status status;
+  struct drawn drawn;
+  struct save_job save;
+  struct watch watch;
+  struct load load;
+  struct viewer viewer;
+  struct hex hex;
+  struct workspace* ws;
+  bool resident; // kept by the daemon after its terminal detaches, see daemon.c
 } Editor;
 
 
@@ -121,17 +431,23 @@ static inline u32 lnlen(Editor* ed, u32 lno) { return lnend(ed, lno) - lnbeg(ed,
 // cursor offset relative to line start
 static inline u32 cursx(Editor* ed) { return cursi(ed) - lnbeg(ed, cursy(ed)); }
 
-// lazily update lineDelta
-static void lncommit(Editor* ed) {
-  if (ed->line_delta == 0) return;
-  for (u32 i = cursy(ed) + 1; i < lncount(ed); i++) {
-    u32 changes = gap_get(&ed->lines, i) + ed->line_delta;
-    gap_set(&ed->lines, i, changes);
+// moves the gap of line index so that line c - 1 holds the cursor. entries behind the gap
+// are short of line_delta, only the ones crossing the gap are settled. so moving over k
+// lines costs k, however many lines follow the cursor
+static void lnmove(Editor* ed, u32 c) {
+  GapBuffer* lines = &ed->lines;
+  c = MIN(c, lncount(ed));
+  for (u32 i = lines->c; i < c; i++) { // settled before moving in front of the gap
+    gap_set(lines, i, gap_get(lines, i) + ed->line_delta);
+  }
+  for (u32 i = c; i < lines->c; i++) { // and made relative after it
+    gap_set(lines, i, gap_get(lines, i) - ed->line_delta);
   }
-  ed->line_delta = 0;
+  gap_move(lines, c);
 }
 
 void set_status(Editor* ed, enum status_msg_type type, const char* fmt, ...) {
+  if (_has(ed->state, replaying)) return; // only the result of a replay is shown
   va_list args;
   va_start(args, fmt);
   vsnprintf(ed->status.msg, STLEN, fmt, args);
@@ -139,34 +455,157 @@ void set_status(Editor* ed, enum status_msg_type type, const char* fmt, ...) {
   va_end(args);
 }
 
+/** @SNAPSHOT **/
+// must be called before touching the storage of ed->buffer. if a save worker is still
+// reading the frozen segments, editor continues on a private copy of them.
+static void buffer_thaw(Editor* ed) {
+  if (!_has(ed->state, saving) || ed->save.detached) return;
+  GapBuffer* gap = &ed->buffer;
+  u32* copy = mem_alloc(mem_text, sizeof(u32) * gap->capacity);
+  if (copy == NULL) {
+    perror("failed to detach buffer from save snapshot");
+    exit(-1);
+  }
+  memcpy(copy, gap->start, sizeof(u32) * gap->c);
+  memcpy(copy + gap->ce + 1, gap->start + gap->ce + 1, sizeof(u32) * (gap->end - gap->ce));
+  gap->start = copy;
+  ed->save.detached = true;
+}
+
+// records a modification to the text buffer
+static inline void mark_modified(Editor* ed) {
+  _set(&ed->state, unwritten_buffer);
+  ed->rev++;
+}
+
+#include "bracket.c"
+#include "diff.c"
+#include "complete.c"
+
+static void macro_touch(Editor* ed, u32 start, u32 end, u32 added);
+
+/** @EDIT **/
+// inserts n characters at cursor. maintains line index, no undo recording or pairing
+static void buffer_insert_raw(Editor* ed, const u32* text, u32 n) {
+  if (n == 0) return;
+  buffer_thaw(ed);
+  u32 at = cursi(ed), line = cursy(ed), added = 0, ws, we;
+  if (_has(ed->state, replaying)) macro_touch(ed, at, at, n);
+  words_drop(ed, at, at, &ws, &we);
+  anchor_insert(&ed->anchors, at, n);
+  synced_edit(&ed->synced, at);
+  for (u32 i = 0; i < n; i++) {
+    if (text[i] == '\n') {
+      gap_insert(&ed->lines, at + i + 1);
+      added++;
+    }
+  }
+  gap_insert_n(&ed->buffer, text, n);
+  bracket_insert(&ed->brackets, at, text, n);
+  diff_edit(&ed->diff, line, 0, added);
+  fold_edit(&ed->folds, line, 0, added);
+  wrap_edit(&ed->wrap, line, 0, added);
+  ed->line_delta += n;
+  words_add(ed, ws, we + n);
+  _reset(&ed->state, blank);
+}
+
+// removes n characters before cursor. maintains line index, no undo recording
+static void buffer_remove_raw(Editor* ed, u32 n) {
+  n = MIN(n, cursi(ed));
+  if (n == 0) return;
+  if (_has(ed->state, replaying)) macro_touch(ed, cursi(ed) - n, cursi(ed), 0);
+  buffer_thaw(ed);
+  bracket_remove(&ed->brackets, cursi(ed), n);
+  u32 removed = 0, ws, we;
+  words_drop(ed, cursi(ed) - n, cursi(ed), &ws, &we);
+  anchor_remove(&ed->anchors, cursi(ed) - n, cursi(ed));
+  synced_edit(&ed->synced, cursi(ed) - n);
+  for (u32 i = 0; i < n; i++) {
+    if (gap_get(&ed->buffer, cursi(ed) - 1) == '\n') {
+      gap_remove(&ed->lines);
+      removed++;
+    }
+    gap_remove(&ed->buffer);
+  }
+  diff_edit(&ed->diff, cursy(ed), removed, 0);
+  fold_edit(&ed->folds, cursy(ed), removed, 0);
+  wrap_edit(&ed->wrap, cursy(ed), removed, 0);
+  ed->line_delta -= n;
+  words_add(ed, ws, we - n);
+  if (GAP_LEN(&ed->buffer) == 0) {
+    _set(&ed->state, blank);
+  }
+}
+
+// appends n characters to the end of buffer without moving the cursor. starts holds
+// the offset into text after each of its nstarts newlines, and is rebased in place
+static void buffer_append_lines(Editor* ed, const u32* text, u32 n, u32* starts, u32 nstarts) {
+  if (n == 0) return;
+  buffer_thaw(ed);
+  u32 len = GAP_LEN(&ed->buffer), last = lncount(ed) - 1, ws, we;
+  words_drop(ed, len, len, &ws, &we);
+  gap_append_n(&ed->buffer, text, n);
+  bracket_append(&ed->brackets, len, text, n);
+  u32 base = len - ed->line_delta; // appended lines are always past the cursor line
+  for (u32 i = 0; i < nstarts; i++) {
+    starts[i] += base;
+  }
+  gap_append_n(&ed->lines, starts, nstarts);
+  diff_edit(&ed->diff, last, 0, nstarts);
+  wrap_edit(&ed->wrap, last, 0, nstarts);
+  words_add(ed, ws, len + n);
+  _reset(&ed->state, blank);
+}
+
+static void buffer_append_raw(Editor* ed, const u32* text, u32 n) {
+  u32* starts = mem_alloc(mem_lines, sizeof(u32) * (lf_count(text, n) + 1));
+  if (starts == NULL) {
+    perror("failed to index appended lines");
+    exit(-1);
+  }
+  buffer_append_lines(ed, text, n, starts, lf_index(text, n, 0, starts));
+  mem_free(mem_lines, starts);
+}
+
+#include "load.c"
+#include "wrap.c"
+
 /** @CURS **/
 static inline void update_sticky_curs(Editor* ed) {
   if (!_has(ed->state, lock_sticky)) {
-    ed->sticky_curs = cursx(ed);
+    ed->sticky_curs = ed->wrap.width > 0 ? wrap_column(ed) : cursx(ed);
   }
 }
 
 static void _curs_mov_vertical(Editor* ed, i32 times) {
   if (times == 0) return;
+  if (times < 0) load_wait(ed, cursy(ed) - times);
   _set(&ed->state, lock_sticky | commit_action);
   u32Da_reset(&ed->pair_stack);
-  lncommit(ed);
+  if (ed->wrap.width > 0) {
+    wrap_curs_vertical(ed, times);
+    goto sticky_reset;
+  }
 
+  // counted in rows on screen, a folded block is a single one
+  u32 row = fold_row(&ed->folds, cursy(ed)), rows = fold_row(&ed->folds, lncount(ed) - 1);
   if (times > 0) {
-    if (cursy(ed) == 0) goto sticky_reset;
-    times = MIN(times, cursy(ed));
+    if (row == 0) goto sticky_reset;
+    times = MIN(times, row);
   } else if (times < 0) {
-    if (cursy(ed) >= lncount(ed) - 1) goto sticky_reset;
-    if (cursy(ed) + -(times) > lncount(ed) - 1) {
-      times = -(lncount(ed) - cursy(ed) - 1);
+    if (row >= rows) goto sticky_reset;
+    if (row + -(times) > rows) {
+      times = -(rows - row);
     }
   }
 
-  u32 target_lno = cursy(ed) - times;
+  u32 target_lno = fold_line(&ed->folds, row - times);
   u32 target_len = lnlen(ed, target_lno);
   u32 target_pos = lnbeg(ed, target_lno) + MIN(ed->sticky_curs, target_len);
+  buffer_thaw(ed);
   gap_move(&ed->buffer, target_pos);
-  gap_move(&ed->lines, target_lno + 1);
+  lnmove(ed, target_lno + 1);
   sticky_reset:
   _reset(&ed->state, lock_sticky);
 }
@@ -177,49 +616,104 @@ static inline void curs_mov_up(Editor* ed, u16 times) { _curs_mov_vertical(ed, t
 // moves cursor down by times
 static inline void curs_mov_down(Editor* ed, u16 times) { _curs_mov_vertical(ed, -times); }
 
+// line number containing logical index pos
+static u32 lnfind(Editor* ed, u32 pos) {
+  u32 lo = 0, hi = lncount(ed) - 1;
+  while (lo < hi) {
+    u32 mid = lo + (hi - lo + 1) / 2;
+    if (lnbeg(ed, mid) <= pos) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return lo;
+}
+
+static void _curs_goto(Editor* ed, u32 pos) {
+  _set(&ed->state, commit_action);
+  u32Da_reset(&ed->pair_stack);
+  pos = MIN(pos, GAP_LEN(&ed->buffer));
+  buffer_thaw(ed);
+  lnmove(ed, lnfind(ed, pos) + 1);
+  gap_move(&ed->buffer, pos);
+  update_sticky_curs(ed);
+}
+
+// move the cursor to logical index pos without walking the characters in between.
+// a fold hiding pos is unfolded
+static void curs_goto(Editor* ed, u32 pos) {
+  _curs_goto(ed, pos);
+  fold_reveal(&ed->folds, cursy(ed));
+}
+
 // move the cursor to the left inside buffer by times
 static void curs_mov_left(Editor* ed, u32 times) {
   _set(&ed->state, commit_action);
+  buffer_thaw(ed);
   while (cursi(ed) > 0 && times > 0) {
     if (gap_get(&ed->buffer, cursi(ed) - 1) == '\n') {
-      lncommit(ed);
-      gap_left(&ed->lines, 1);
+      lnmove(ed, ed->lines.c - 1);
     }
     gap_left(&ed->buffer, 1);
     times--;
   }
+  if (fold_hidden(&ed->folds, cursy(ed))) { // moved back into a folded block, to its first line
+    _curs_goto(ed, lnend(ed, fold_line(&ed->folds, fold_row(&ed->folds, cursy(ed)))));
+  }
   update_sticky_curs(ed);
 }
 
 // move the cursor to the right inside buffer by times
 static void curs_mov_right(Editor* ed, u32 times) {
   _set(&ed->state, commit_action);
+  buffer_thaw(ed);
   while (cursi(ed) < GAP_LEN(&ed->buffer) && times > 0) {
     if (gap_get(&ed->buffer, cursi(ed)) == '\n') {
-      lncommit(ed);
-      gap_right(&ed->lines, 1);
+      lnmove(ed, ed->lines.c + 1);
     }
     gap_right(&ed->buffer, 1);
     times--;
   }
+  if (fold_hidden(&ed->folds, cursy(ed))) { // moved into a folded block, past it
+    u32 row = fold_row(&ed->folds, cursy(ed)), next = fold_line(&ed->folds, row + 1);
+    _curs_goto(ed, next < lncount(ed) ? lnbeg(ed, next) : lnend(ed, fold_line(&ed->folds, row)));
+  }
   update_sticky_curs(ed);
 }
 
-// move the cursor to desired logical index (pos)
-static void curs_mov(Editor* ed, u32 pos) {
-  if (cursi(ed) < pos) {
-    curs_mov_right(ed, pos - cursi(ed));
-  } else if (cursi(ed) > pos) {
-    curs_mov_left(ed, cursi(ed) - pos);
+// finds the bracket under the cursor (or else right before it) and its partner.
+// *paired is set to false if the two are not of the same kind
+static bool curs_bracket(Editor* ed, u32* at, u32* match, bool* paired) {
+  *at = cursi(ed);
+  if (!is_bracket(gap_get(&ed->buffer, *at)) && *at > 0) {
+    (*at)--;
+  }
+  if (!bracket_match(&ed->brackets, *at, match)) return false;
+  u32 a = gap_get(&ed->buffer, MIN(*at, *match)), b = gap_get(&ed->buffer, MAX(*at, *match));
+  *paired = _brk_pairs(a, b);
+  return true;
+}
+
+static void curs_jump_match(Editor* ed) {
+  u32 at, match;
+  bool paired;
+  if (!curs_bracket(ed, &at, &match, &paired)) {
+    set_status(ed, st_warn, "no matching bracket.");
+    return;
+  }
+  curs_goto(ed, match);
+  if (!paired) {
+    set_status(ed, st_warn, "brackets don't pair: %lc %lc", gap_get(&ed->buffer, MIN(at, match)), gap_get(&ed->buffer, MAX(at, match)));
   }
 }
 
 
 /** @ACTION **/
 // inorder to create a action frame, the trace field should be recorded initially
-static inline struct action action_init(u32 start, enum timeline_op op) {
+static inline struct action action_init(struct mem_blocks* frames, u32 start, enum timeline_op op) {
   return (struct action) {
-    .frame = u32Da_init(DEFAULT_ACTION_FRAME_SIZ),
+    .frame = u32Da_init_block(frames),
     .op = op,
     .start = start,
   };
@@ -255,6 +749,7 @@ static struct timeline timeline_init() {
   struct timeline tl = {0};
   tl.utop = STK_EMTY;
   tl.rtop = STK_EMTY;
+  tl.frames = mem_blocks_init(mem_undo, sizeof(u32) * DEFAULT_ACTION_FRAME_SIZ);
   clock_gettime(CLOCK_MONOTONIC, &tl.time);
   return tl;
 }
@@ -276,8 +771,10 @@ static void editor_update_timeline(Editor* ed, u32 ch, enum timeline_op op) {
       || _has(ed->state, commit_action) // editor explictly instruct to commit
       || elapsed_seconds(&ed->tl.time) > UNDO_EXPIRY // time expired since last action
       || op != undo[*top % UNDO_LIMIT].op // current operation is different from previous
+      || ed->tl.group != undo[*top % UNDO_LIMIT].group // crossing a group boundary
   ) {
-    struct action new = action_init(cursi(ed), op);
+    struct action new = action_init(&ed->tl.frames, cursi(ed), op);
+    new.group = ed->tl.group;
     action_push(undo, top, new);
     _reset(&ed->state, commit_action);
   }
@@ -285,6 +782,31 @@ static void editor_update_timeline(Editor* ed, u32 ch, enum timeline_op op) {
   timeline_fetch_time(ed);
 }
 
+// opens a new undo group. every action recorded until timeline_group_end is undone at once
+static inline void timeline_group_begin(Editor* ed) {
+  ed->tl.group = ++ed->tl.groups;
+  _set(&ed->state, commit_action);
+}
+
+static inline void timeline_group_end(Editor* ed) {
+  ed->tl.group = 0;
+  _set(&ed->state, commit_action);
+}
+
+// records an already performed action as a whole
+static void timeline_record(Editor* ed, enum timeline_op op, u32 start, const u32* chars, u32 n) {
+  if (n == 0) return;
+  if (ed->tl.rtop != STK_EMTY) timeline_redo_free(&ed->tl);
+  struct action new = action_init(&ed->tl.frames, start, op);
+  new.group = ed->tl.group;
+  for (u32 i = 0; i < n; i++) {
+    u32Da_insert(&new.frame, chars[i], _END(0));
+  }
+  action_push(ed->tl.undo, &ed->tl.utop, new);
+  _set(&ed->state, commit_action);
+  timeline_fetch_time(ed);
+}
+
 void timeline_free(struct timeline* tl) {
   timeline_redo_free(tl);
   for (u32 i = 0; i < UNDO_LIMIT; i++) {
@@ -292,6 +814,7 @@ void timeline_free(struct timeline* tl) {
       action_free(&tl->undo[i]);
     }
   }
+  mem_blocks_free(&tl->frames);
 }
 
 
@@ -342,8 +865,8 @@ static inline u32 pop_pair(Editor* ed) { return u32Da_remove(&ed->pair_stack, _E
 static inline bool _is_empty_pair_stk(Editor* ed) { return ed->pair_stack.len == 0; }
 
 static void editor_insert(Editor* ed, u32 new_ch) {
-  set_status(ed, st_norm, "%ls::%x width: %hhd", &new_ch, new_ch, wcwidth(new_ch));
-  if (!_has_any(ed->state, undoing | lock_modify)) {
+  set_status(ed, st_norm, "%ls::%x width: %hhd", &new_ch, new_ch, ucs_width(new_ch));
+  if (!_has_any(ed->state, undoing | lock_modify | replaying)) {
     editor_update_timeline(ed, new_ch, op_ins);
   }
   // skip closing pair if exists
@@ -357,19 +880,12 @@ static void editor_insert(Editor* ed, u32 new_ch) {
     }
   }
 
-  gap_insert(&ed->buffer, new_ch);
-  ed->line_delta++;
-  if (new_ch == '\n') { // handling lines
-    gap_insert(&ed->lines, cursi(ed));
-  } 
+  buffer_insert_raw(ed, &new_ch, 1);
   update_sticky_curs(ed);
 
-  if (_has(ed->state, blank)) {
-    _reset(&ed->state, blank);
-  }
-
   if (_has(ed->state, lock_modify)) return;
   // following instructions will be ignored in lock_modify state
+  mark_modified(ed);
 
   u32 prev_ch = gap_get(&ed->buffer, cursi(ed) - 2);
   // pair insertion (if any)
@@ -383,8 +899,6 @@ static void editor_insert(Editor* ed, u32 new_ch) {
     curs_mov_left(ed, 1);
     _reset(&ed->state, pairing);
   }
-
-  _set(&ed->state, unwritten_buffer);
 }
 
 static void indent_from_prevln(Editor* ed) {
@@ -429,22 +943,14 @@ static void editor_removel(Editor* ed) {
   }
 
   while (removing_items > 0) {
-    u32 ch = gap_get(&ed->buffer, rmidx);
-    if (!_has(ed->state, undoing)) {
-      editor_update_timeline(ed, ch, op_del);
+    if (!_has_any(ed->state, undoing | replaying)) {
+      editor_update_timeline(ed, gap_get(&ed->buffer, cursi(ed) - 1), op_del);
     }
-    gap_remove(&ed->buffer);
-    ed->line_delta--;
+    buffer_remove_raw(ed, 1);
     removing_items--;
   }
-  if (removing_ch == '\n') {
-    gap_remove(&ed->lines); // removing line entry
-  }
   update_sticky_curs(ed);
-  if (GAP_LEN(&ed->buffer) == 0) {
-    _set(&ed->state, blank);
-  }
-  _set(&ed->state, unwritten_buffer);
+  mark_modified(ed);
 }
 
 static void editor_remover(Editor* ed) {
@@ -456,16 +962,23 @@ static void timeline_invert_action(Editor* ed, struct action* action) {
   if (action->op == op_idle) return;
   
   action->start += action->op * action->frame.len;
-  curs_mov(ed, action->start);
+  curs_goto(ed, action->start);
   if (action->op == op_ins) {
-    for (isize i = 0; i < action->frame.len; i++) {
-      editor_removel(ed);
+    buffer_remove_raw(ed, action->frame.len);
+  } else if (action->op == op_del) { // frame holds the removed characters in reverse
+    u32* text = mem_alloc(mem_undo, sizeof(u32) * (action->frame.len + 1));
+    if (text == NULL) {
+      perror("timeline_invert_action");
+      exit(-1);
     }
-  } else if (action->op == op_del) {
     for (isize i = 0; i < action->frame.len; i++) {
-      editor_insert(ed, u32Da_get(&action->frame, _END(i)));
+      text[i] = u32Da_get(&action->frame, _END(i));
     }
+    buffer_insert_raw(ed, text, action->frame.len);
+    mem_free(mem_undo, text);
   }
+  update_sticky_curs(ed);
+  mark_modified(ed);
   action->op *= STK_EMTY;
 
   // reverse the vector action->frame
@@ -478,26 +991,87 @@ static void timeline_invert_action(Editor* ed, struct action* action) {
   }
 }
 
-void editor_undo(Editor* ed) {
+// moves the top action (along with the rest of its group) from one stack to the other
+static void timeline_transfer(Editor* ed, struct action* from, isize* ftop, struct action* to, isize* ttop) {
   _set(&ed->state, undoing);
-  struct action* action = action_pop(ed->tl.undo, &ed->tl.utop);
-  if (action == NULL) goto reset;
-  timeline_invert_action(ed, action);
-  action_push(ed->tl.redo, &ed->tl.rtop, *action);
-  action->op = op_idle;
-  reset:
-    _reset(&ed->state, undoing);
+  u32 group;
+  do {
+    struct action* action = action_pop(from, ftop);
+    if (action == NULL) break;
+    group = action->group;
+    timeline_invert_action(ed, action);
+    action_push(to, ttop, *action);
+    action->op = op_idle;
+  } while (group != 0 && *ftop != STK_EMTY && from[*ftop % UNDO_LIMIT].group == group);
+  _set(&ed->state, commit_action);
+  _reset(&ed->state, undoing);
 }
 
-void editor_redo(Editor* ed) {
-  _set(&ed->state, undoing);
-  struct action* action = action_pop(ed->tl.redo, &ed->tl.rtop);
-  if (action == NULL) goto reset;
-  timeline_invert_action(ed, action);
-  action_push(ed->tl.undo, &ed->tl.utop, *action);
-  action->op = op_idle;
-  reset:
-    _reset(&ed->state, undoing);
+void editor_undo(Editor* ed) { timeline_transfer(ed, ed->tl.undo, &ed->tl.utop, ed->tl.redo, &ed->tl.rtop); }
+
+void editor_redo(Editor* ed) { timeline_transfer(ed, ed->tl.redo, &ed->tl.rtop, ed->tl.undo, &ed->tl.utop); }
+
+// records the removed characters old at start being replaced by n characters of text,
+// as a single undo step. the edit itself is already done, or is done by the caller
+static void timeline_record_replace(Editor* ed, u32 start, const u32* old, u32 removed, const u32* text, u32 n) {
+  u32* rev = mem_alloc(mem_undo, sizeof(u32) * (removed + 1));
+  if (rev == NULL) {
+    perror("timeline_record_replace");
+    exit(-1);
+  }
+  for (u32 i = 0; i < removed; i++) { // recorded in the order editor_removel would
+    rev[i] = old[removed - 1 - i];
+  }
+  timeline_group_begin(ed);
+  timeline_record(ed, op_del, start + removed, rev, removed);
+  timeline_record(ed, op_ins, start, text, n);
+  timeline_group_end(ed);
+  mem_free(mem_undo, rev);
+}
+
+// replaces characters in [start, end) by n characters of text as a single undo step
+static void editor_replace(Editor* ed, u32 start, u32 end, const u32* text, u32 n) {
+  end = MIN(end, GAP_LEN(&ed->buffer));
+  start = MIN(start, end);
+  curs_goto(ed, end); // storage of the range is contiguous before the gap
+  u32 removed = end - start;
+  if (!_has(ed->state, replaying)) { // a replay records its edits once it ends
+    timeline_record_replace(ed, start, ed->buffer.start + start, removed, text, n);
+  }
+
+  buffer_remove_raw(ed, removed);
+  buffer_insert_raw(ed, text, n);
+  u32Da_reset(&ed->pair_stack);
+  update_sticky_curs(ed);
+  mark_modified(ed);
+}
+
+// turns buffer decoded as crlf into lf by putting a '\r' back before every '\n', for a
+// file that mixes line endings. the file still holds what buffer does. undo history is
+// dropped, its positions are those of the text without them
+static void buffer_to_lf(Editor* ed) {
+  u32 y = cursy(ed), x = cursx(ed);
+  struct synced kept = ed->synced; // points move by the newlines before them
+  for (u32 i = 0; i < kept.n; i++) {
+    kept.v[i].chars += lnfind(ed, kept.v[i].chars);
+  }
+  if (kept.dirty != SYNCED_NONE) {
+    kept.dirty += lnfind(ed, kept.dirty);
+  }
+  synced_init(&ed->synced);
+  const u32 cr = '\r';
+  for (u32 line = 0; line + 1 < lncount(ed); line++) {
+    _curs_goto(ed, lnend(ed, line));
+    buffer_insert_raw(ed, &cr, 1);
+  }
+  _curs_goto(ed, lnbeg(ed, y) + x);
+  ed->synced = kept;
+  ed->rev++;
+  if (ed->tl.utop != STK_EMTY || ed->tl.rtop != STK_EMTY) {
+    timeline_free(&ed->tl);
+    ed->tl = timeline_init();
+    set_status(ed, st_warn, "file mixes line endings, undo history is dropped to keep them.");
+  }
 }
 
 static inline void display_help(Editor* ed, WINDOW* edwin, u16 win_w, u16 win_h) {
@@ -509,6 +1083,15 @@ static inline void display_help(Editor* ed, WINDOW* edwin, u16 win_w, u16 win_h)
     "ctrl[s] : Write to file",
     "ctrl[u] : Undo last action",
     "ctrl[r] : Redo last undo",
+    "ctrl[t] : Follow appends to file",
+    "ctrl[b] : Jump to matching bracket",
+    "ctrl[d] : Diff against file on disk",
+    "ctrl[f] : Fold or unfold block",
+    "ctrl[n] : Complete word, again for the next",
+    "ctrl[o] : Set mark named by the next letter",
+    "ctrl[g] : Jump to mark named by the next letter",
+    "ctrl[k] : Start or stop recording macro",
+    "ctrl[e] : Replay recorded macro",
     "F2      : Open command pallete",
   };
 
@@ -531,37 +1114,58 @@ static inline void display_help(Editor* ed, WINDOW* edwin, u16 win_w, u16 win_h)
 // return distance to next tabstop from pos
 static inline u8 tabstop_distance(u32 pos) { return TAB_STOPS - (pos % TAB_STOPS); }
 
+// true for control characters kept in buffer, like '\r' of mixed line endings. they
+// are shown as ^M and the like
+static inline bool is_caret(u32 ch) { return (ch < 0x20 && ch != '\t' && ch != '\n') || ch == 0x7f; }
+
+// visual width of ch drawn at visual column vx. escaped bytes and anything else not
+// printable take a single column
+static inline u8 char_width(u32 ch, u32 vx) {
+  if (ch == '\t') return tabstop_distance(vx);
+  if (is_caret(ch)) return 2;
+  if (utf8_is_escape(ch)) return 1;
+  i8 width = ucs_width(ch);
+  return width < 0 ? 1 : width;
+}
+
 // returns visual length(length with tab character) from start to (i < end)
 static u32 vlen(Editor* ed, u32 start, u32 end) {
   u32 width = 0;
   for (u32 i = start; i < end; i++) {
-    u32 ch = gap_get(&ed->buffer, i);
-    if (ch == '\t') {
-      width += tabstop_distance(width);
-    } else {
-      width += wcwidth(ch);
-    }
+    width += char_width(gap_get(&ed->buffer, i), width);
   }
   return width;
 }
 
-static void update_view(Editor* ed, u16 win_h, u16 win_w) {
-  // updating view.y
-  u32 vy = ed->view.y, vx = ed->view.x;
+// scrolls view so that cursor at line cy and visual column visual_cursx stays visible
+static void scroll_to(Editor* ed, u32 cy, u32 visual_cursx, u16 win_h, u16 win_w) {
+  // updating view.y, in rows on screen
+  u32 vy, vx = ed->view.x;
+  if (ed->wrap.on) { // rows of cursor line before its column count too
+    vy = wrap_row(&ed->wrap, ed->view.y) + ed->view.sub;
+    cy = wrap_row(&ed->wrap, cy) + visual_cursx / ed->wrap.width;
+  } else {
+    vy = fold_row(&ed->folds, ed->view.y);
+    cy = fold_row(&ed->folds, cy);
+  }
   const u32 scroll_down_threshold = vy + win_h - SCROLL_BOUNDRY - 1;
-  if (cursy(ed) > scroll_down_threshold) {
-    vy += cursy(ed) - scroll_down_threshold; // scroll down
-  } else if (cursy(ed) < vy + SCROLL_BOUNDRY) {
-    if (cursy(ed) < SCROLL_BOUNDRY) { // scroll up
+  if (cy > scroll_down_threshold) {
+    vy += cy - scroll_down_threshold; // scroll down
+  } else if (cy < vy + SCROLL_BOUNDRY) {
+    if (cy < SCROLL_BOUNDRY) { // scroll up
       vy = 0;
     } else {
-      vy = cursy(ed) - SCROLL_BOUNDRY;
+      vy = cy - SCROLL_BOUNDRY;
     }
   }
+  if (ed->wrap.on) { // nothing to scroll sideways
+    ed->view.y = wrap_line(&ed->wrap, vy, &ed->view.sub);
+    ed->view.x = 0;
+    return;
+  }
 
   // updating view.x
   const u16 content_w = win_w - LNO_PADDING;
-  const u32 visual_cursx = vlen(ed, lnbeg(ed, cursy(ed)), cursi(ed)); // find visual cursx position
   const u32 scroll_right_threshold = vx + content_w - SCROLL_BOUNDRY;
 
   if (visual_cursx >= scroll_right_threshold) {
@@ -573,208 +1177,724 @@ static void update_view(Editor* ed, u16 win_h, u16 win_w) {
       vx = visual_cursx - SCROLL_BOUNDRY;
     }
   }
-  if (vx != ed->view.x || vy != ed->view.y) {
-    ed->view.y = vy;
-    ed->view.x = vx;
+  ed->view.y = fold_line(&ed->folds, vy);
+  ed->view.x = vx;
+}
+
+// window row of line, the text starts at row 1. 0 if it is above the view or folded away
+static inline u32 view_row(Editor* ed, u32 line) {
+  if (line < ed->view.y || fold_hidden(&ed->folds, line)) return 0;
+  return fold_row(&ed->folds, line) - fold_row(&ed->folds, ed->view.y) + 1;
+}
+
+// window row and column of visual column vx of line. false if it is not on screen
+static bool view_cell(Editor* ed, u32 line, u32 vx, u16 win_h, u16 win_w, u16* vy, u16* sx) {
+  if (ed->wrap.on) {
+    i64 row = (i64)wrap_row(&ed->wrap, line) + vx / ed->wrap.width - wrap_row(&ed->wrap, ed->view.y) - ed->view.sub;
+    if (fold_hidden(&ed->folds, line) || row < 0 || row + 1 >= win_h) return false;
+    *vy = row + 1;
+    *sx = vx % ed->wrap.width + LNO_PADDING;
+    return true;
+  }
+  u32 row = view_row(ed, line);
+  if (row == 0 || row >= win_h || vx < ed->view.x || vx - ed->view.x + LNO_PADDING >= win_w) return false;
+  *vy = row;
+  *sx = vx - ed->view.x + LNO_PADDING;
+  return true;
+}
+
+static void update_view(Editor* ed, u16 win_h, u16 win_w) {
+  if (ed->wrap.on) {
+    wrap_settle(ed, MAX(win_w - LNO_PADDING, 1));
+  }
+  const u32 visual_cursx = vlen(ed, lnbeg(ed, cursy(ed)), cursi(ed)); // find visual cursx position
+  scroll_to(ed, cursy(ed), visual_cursx, win_h, win_w);
+}
+
+static void print_statusln(WINDOW* edwin, Editor* ed, u16 win_w) {
+  mvwchgat(edwin, 0, 0, -1, A_NORMAL, STATLN_PAIR, NULL);
+  u16 x = 1;
+  char* str = "[+]";
+  wattron(edwin, COLOR_PAIR(STATLN_PAIR));
+  if (_has(ed->state, saving)) {
+    mvwprintw(edwin, 0, x, "%s", "[~]");
+  } else if (_has(ed->state, unwritten_buffer)) {
+    mvwprintw(edwin, 0, x, "%s", str);
+  }
+  x += strlen(str);
+
+  if (*ed->bufname == '\0') {
+    str = "scratch buffer";
+  } else {
+    str = ed->bufname;
+  }
+  u32 len = clamp(strlen(str), 0, win_w - x);
+  for (u32 i = 0; i < len; i++) {
+    mvwaddch(edwin, 0, x++, str[i]);
+  }
+  char mode[STLEN] = "";
+  if (ed->load.active) { // line count is estimated from the bytes decoded until it is counted
+    bool counted = atomic_load(&ed->load.counted);
+    u64 newlines = atomic_load(&ed->load.newlines), decoded = atomic_load(&ed->load.decoded);
+    snprintf(mode, STLEN, " [loading %d%%, %s%llu lines]", (int)(ed->load.offset * 100 / ed->load.size),
+      counted ? "" : "~", (unsigned long long)(counted ? newlines + 1 : (newlines + 1) * ed->load.size / MAX(decoded, 1)));
+  } else if (ed->ws->macro.recording) {
+    strcpy(mode, " [recording]");
+  } else if (ed->watch.follow) {
+    strcpy(mode, " [follow]");
+  } else if (ed->diff.on) {
+    strcpy(mode, " [diff]");
+  } else if (ed->wrap.on) {
+    strcpy(mode, " [wrap]");
+  } else if (ed->mode == mode_hex) {
+    snprintf(mode, STLEN, " [hex%s, 0x%llx]", ed->hex.writable ? "" : ", read-only", (unsigned long long)ed->hex.curs);
+  } else if (ed->mode == mode_view) {
+    u64 scanned = atomic_load(&ed->viewer.scanned);
+    if (scanned < ed->viewer.size) {
+      snprintf(mode, STLEN, " [read-only, indexing %d%%]", (int)(scanned * 100 / ed->viewer.size));
+    } else {
+      strcpy(mode, " [read-only]");
+    }
+  }
+  len = clamp(strlen(mode), 0, win_w - x);
+  for (u32 i = 0; i < len; i++) {
+    mvwaddch(edwin, 0, x++, mode[i]);
+  }
+
+  if (ed->status.type != st_nothing) {
+    str = ed->status.msg;
+    len = clamp(strlen(str), 0, win_w - x - 2);
+    x = win_w - len - 1;
+    wattron(edwin, COLOR_PAIR(ed->status.type));
+    for (u32 i = 0; i < len; i++) {
+      mvwaddch(edwin, 0, x++, str[i]);
+    }
+    wattroff(edwin, COLOR_PAIR(ed->status.type));
+    ed->status.type = st_nothing;
+  }
+  wattroff(edwin, COLOR_PAIR(STATLN_PAIR));
+}
+
+static void highlight_curs(WINDOW* edwin, u16 cx, u16 cy) {
+  mvwchgat(edwin, cy, 0, LNO_PADDING - 1, A_NORMAL | A_BOLD, TXT_GREEN, NULL); // keeps the diff marker
+  mvwchgat(edwin, cy, cx, 1, A_REVERSE, PAIR_NUMBER(mvwinch(edwin, cy, cx) & A_COLOR), NULL);
+}
+
+// marks the bracket at pos if it is on screen. unpaired brackets are marked as warning
+static void highlight_bracket(WINDOW* edwin, Editor* ed, u32 pos, bool paired, u16 win_h, u16 win_w) {
+  u32 line = lnfind(ed, pos);
+  u16 vy, sx;
+  if (!view_cell(ed, line, vlen(ed, lnbeg(ed, line), pos), win_h, win_w, &vy, &sx)) return;
+  mvwchgat(edwin, vy, sx, 1, A_BOLD | A_UNDERLINE,
+           paired ? TXT_GREEN : STATLN_WARN_PAIR, NULL);
+}
+
+static inline void draw_lno(WINDOW* edwin, u16 vy, u32 line) {
+  wattron(edwin, COLOR_PAIR(COMMENT_PAIR));
+  mvwprintw(edwin, vy, 0, "%5d ", line + 1);
+  wattroff(edwin, COLOR_PAIR(COMMENT_PAIR));
+}
+
+// draws ch at visual column vx of row vy, if it falls inside the view starting at view_x.
+// returns the visual width of ch
+static u8 draw_char(WINDOW* edwin, u16 vy, u32 vx, u32 ch, u32 view_x, u16 win_w) {
+  const u16 content_w = win_w - LNO_PADDING;
+  bool shown = !utf8_is_escape(ch) && ucs_width(ch) >= 0;
+  wchar_t wch[2] = {shown ? ch : UTF8_REPLACEMENT, 0};
+  cchar_t cchar;
+  u8 width = char_width(ch, vx);
+
+  if (vx + width > view_x && vx < view_x + content_w) {
+    u32 screen_x = vx + LNO_PADDING - view_x;
+    if (ch == '\t' || is_caret(ch)) {
+      char caret[2] = { '^', ch ^ 0x40 };
+      for (u32 k = 0; k < width; k++) {
+        if (vx + k >= view_x && screen_x + k < win_w) {
+          mvwaddch(edwin, vy, screen_x + k, ch == '\t' ? ' ' : caret[k]);
+        }
+      }
+    } else if (screen_x < win_w) {
+      setcchar(&cchar, wch, A_NORMAL, EDITOR_PAIR, NULL);
+      mvwadd_wch(edwin, vy, screen_x, &cchar);
+    }
+  }
+  return width;
+}
+
+// paints line on row vy of the text area from scratch
+static void draw_row(WINDOW* edwin, Editor* ed, u16 vy, u32 line, u16 win_w) {
+  wmove(edwin, vy, 0);
+  wclrtoeol(edwin);
+  if (line == lncount(ed)) {
+    wattron(edwin, COLOR_PAIR(COMMENT_PAIR));
+    mvwprintw(edwin, vy, 0, "      ~");
+    wattroff(edwin, COLOR_PAIR(COMMENT_PAIR));
+  }
+  if (line >= lncount(ed)) return;
+  u32 start = lnbeg(ed, line);
+  u32 len = lnlen(ed, line);
+
+  draw_lno(edwin, vy, line);
+  diff_draw(edwin, ed, vy, line);
+
+  u32 vx = 0;
+  for (u32 i = 0; i < len; i++) {
+    vx += draw_char(edwin, vy, vx, gap_get(&ed->buffer, start + i), ed->view.x, win_w);
+  }
+  struct fold* fd = fold_at(&ed->folds, line);
+  u32 x = LNO_PADDING + (vx > ed->view.x ? vx - ed->view.x : 0);
+  if (fd != NULL && x + 1 < win_w) {
+    char more[32];
+    snprintf(more, sizeof(more), " ... %u lines", fd->last - fd->first);
+    wattron(edwin, COLOR_PAIR(COMMENT_PAIR));
+    mvwaddnstr(edwin, vy, x, more, win_w - x - 1);
+    wattroff(edwin, COLOR_PAIR(COMMENT_PAIR));
   }
 }
 
+// paints line wrapped over the rows from vy on, starting with its row sub. returns the
+// window row after the last one painted
+static u16 draw_wrapped(WINDOW* edwin, Editor* ed, u16 vy, u32 line, u32 sub, u16 win_h, u16 win_w) {
+  if (line >= lncount(ed)) {
+    draw_row(edwin, ed, vy, line, win_w);
+    return vy + 1;
+  }
+  u32 start = lnbeg(ed, line), len = lnlen(ed, line), width = ed->wrap.width;
+  if (sub == 0) {
+    draw_lno(edwin, vy, line);
+    diff_draw(edwin, ed, vy, line);
+  }
+  u32 vx = 0;
+  for (u32 i = 0; i < len; i++) {
+    u32 ch = gap_get(&ed->buffer, start + i), row = vx / width;
+    if (row >= sub + win_h - vy) break;
+    if (row >= sub) {
+      vx += draw_char(edwin, vy + row - sub, vx, ch, row * width, win_w);
+    } else {
+      vx += char_width(ch, vx);
+    }
+  }
+  struct fold* fd = fold_at(&ed->folds, line);
+  u32 y = vy + vx / width - sub, x = LNO_PADDING + vx % width;
+  if (fd != NULL && y < win_h && x + 1 < win_w) {
+    char more[32];
+    snprintf(more, sizeof(more), " ... %u lines", fd->last - fd->first);
+    wattron(edwin, COLOR_PAIR(COMMENT_PAIR));
+    mvwaddnstr(edwin, y, x, more, win_w - x - 1);
+    wattroff(edwin, COLOR_PAIR(COMMENT_PAIR));
+  }
+  u32 rows = wrap_rows(&ed->wrap, line);
+  return MIN((u64)vy + rows - MIN(sub, rows - 1), win_h);
+}
+
+// brings the window up to date by scrolling the rows it shows, if nothing but view.y
+// changed since the last draw. with idlok on, curses moves them with the scroll region
+// of the terminal instead of sending them again. returns false if it has to be redrawn
+static bool draw_scrolled(WINDOW* edwin, Editor* ed, u16 win_h, u16 win_w) {
+  struct drawn* d = &ed->drawn;
+  u32 top = fold_row(&ed->folds, ed->view.y);
+  i64 dy = (i64)top - fold_row(&ed->folds, d->y);
+  if (!d->valid || d->h != win_h || d->w != win_w || d->x != ed->view.x || d->rev != ed->rev ||
+      d->len != GAP_LEN(&ed->buffer) || d->lines != lncount(ed) || d->folds != ed->folds.rev ||
+      ed->diff.on || ed->wrap.on || ed->ws->palette.open || dy >= win_h - 1 || -dy >= win_h - 1) {
+    return false;
+  }
+  if (dy != 0) {
+    wsetscrreg(edwin, 1, win_h - 1);
+    scrollok(edwin, TRUE);
+    wscrl(edwin, dy);
+    scrollok(edwin, FALSE); // writing the bottom right corner must not scroll
+  }
+  u16 from = dy > 0 ? win_h - dy : 1, to = dy > 0 ? win_h : 1 - dy;
+  for (u16 vy = from; vy < to; vy++) {
+    draw_row(edwin, ed, vy, fold_line(&ed->folds, top + vy - 1), win_w);
+  }
+  for (u32 i = 0; i < 3; i++) { // highlights move along with their rows
+    u32 vy = view_row(ed, d->marked[i]);
+    if (vy > 0 && vy < win_h) {
+      draw_row(edwin, ed, vy, d->marked[i], win_w);
+    }
+  }
+  wmove(edwin, 0, 0);
+  wclrtoeol(edwin);
+  return true;
+}
+
+#include "watch.c"
+#include "viewer.c"
+#include "hex.c"
+#include "fold.c"
+#include "mark.c"
+
 // @FILE_HANDLING
-static void fetch_file_content(Editor* ed) {
-  _set(&ed->state, lock_modify);
-  u32 ch;
-  while ((ch = fgetwc(ed->fp)) != WEOF) {
-    editor_insert(ed, ch);
+// absolute form of path, which need not exist yet
+static void abs_path(const char* path, char* out) {
+  if (realpath(path, out) != NULL) return;
+  char cwd[PATH_MAX] = "";
+  if (*path != '/' && getcwd(cwd, PATH_MAX) == NULL) *cwd = '\0';
+  snprintf(out, PATH_MAX, "%s%s%s", cwd, *cwd ? "/" : "", path);
+}
+
+// names buffer after the file at path. a resident outlives the working directory path
+// is relative to, so it keeps the absolute path instead
+static void set_bufname(Editor* ed, const char* path) {
+  if (ed->resident) {
+    abs_path(path, ed->bufname);
+  } else {
+    strncpy(ed->bufname, path, PATH_MAX - 1);
   }
-  curs_mov(ed, 0);
-  _reset(&ed->state, lock_modify);
 }
 
-static void open_from_file(Editor* ed, char* filepath) {
+// opens the file at filepath into ed. a file that can't be opened leaves a scratch
+// buffer and a warning in status. returns true if filepath was a directory
+static bool open_from_file(Editor* ed, char* filepath) {
   struct stat st;
   if (stat(filepath, &st) == 0) { // obtains file stat
-    if (S_ISDIR(st.st_mode)) { // if it is a directory
-      // directory TODO
-      return;
+    if (S_ISDIR(st.st_mode)) { // becomes the working directory, files are opened from palette
+      if (chdir(filepath) == -1) {
+        set_status(ed, st_warn, "chdir: %s", strerror(errno));
+        return false;
+      }
+      return true;
+    } else if (ed->mode == mode_hex || (ed->mode == mode_edit && hex_sniff(filepath))) {
+      if (hex_open(ed, filepath)) set_bufname(ed, filepath);
+    } else if (ed->mode == mode_view || st.st_size >= VIEWER_THRESHOLD) {
+      if (viewer_open(ed, filepath)) set_bufname(ed, filepath);
     } else { // reading from existing file
-      strncpy(ed->bufname, filepath, STLEN);
-      ed->fp = fopen(filepath, "r+");
+      set_bufname(ed, filepath);
+      ed->fp = fopen(filepath, "r+e");
       if (ed->fp == NULL) {
         perror("fopen");
       }
-      fetch_file_content(ed);
+      if (!load_start(ed)) { // nothing of the file must be saved over it
+        if (ed->fp != NULL) fclose(ed->fp);
+        ed->fp = NULL;
+        *ed->bufname = '\0';
+        return false;
+      }
+      watch_start(ed);
     }
   } else { // file doesn't exist, but saving given filename to create one later
-    strncpy(ed->bufname, filepath, STLEN);
+    set_bufname(ed, filepath);
+  }
+  return false;
+}
+
+// leaves a point where the save has got to, so a later save can start there
+static void _save_point(struct save_job* job, u32 chars, off_t bytes) {
+  if (job->npoints % 64 == 0) {
+    struct save_point* grown = mem_realloc(mem_misc, job->points, sizeof(struct save_point) * (job->npoints + 64));
+    if (grown == NULL) return;
+    job->points = grown;
   }
+  job->points[job->npoints++] = (struct save_point){ chars, bytes };
+}
+
+// encodes the frozen segments after job->from into the file. runs on its own thread
+static void* save_worker(void* arg) {
+  struct save_job* job = arg;
+  byte* out = mem_alloc(mem_io, SAVE_CHUNK * 4 + SAVE_CHUNK); // room for a '\r' before each '\n'
+  if (out == NULL) {
+    job->err = ENOMEM;
+    goto done;
+  }
+  struct { const u32* at; u32 len; } segments[] = {
+    { job->frozen, job->c },
+    { job->frozen + job->ce + 1, job->end - job->ce },
+  };
+  off_t offset = job->from.bytes;
+  u32 base = 0, pointed = job->from.chars; // characters before the segment, and the last point
+  for (u8 s = 0; s < 2 && job->err == 0; base += segments[s++].len) {
+    u32 i = MIN(segments[s].len, job->from.chars > base ? job->from.chars - base : 0);
+    for (; i < segments[s].len && job->err == 0; i += SAVE_CHUNK) {
+      u32 count = MIN(SAVE_CHUNK, segments[s].len - i);
+      usize n = utf8_encode_text(segments[s].at + i, count, out, job->eol);
+      for (usize w = 0; w < n;) {
+        ssize_t res = pwrite(job->fd, out + w, n - w, offset);
+        if (res == -1) {
+          if (errno == EINTR) continue;
+          job->err = errno;
+          break;
+        }
+        w += res;
+        offset += res;
+      }
+      if (base + i + count - pointed >= SAVE_POINT) {
+        pointed = base + i + count;
+        _save_point(job, pointed, offset);
+      }
+    }
+  }
+  if (job->err == 0 && ftruncate(job->fd, offset) == -1) {
+    job->err = errno;
+  }
+  if (job->err == 0 && pointed != job->len) {
+    _save_point(job, job->len, offset);
+  }
+  job->size = offset;
+  mem_free(mem_io, out);
+  done:
+  atomic_store(&job->done, true);
+  wake_signal();
+  return NULL;
+}
+
+// collects a finished save job. returns true if the job was finished
+static bool save_finish(Editor* ed, bool wait) {
+  if (!_has(ed->state, saving)) return false;
+  if (!wait && !atomic_load(&ed->save.done)) return false;
+  pthread_join(ed->save.thread, NULL);
+  if (ed->save.detached) {
+    mem_free(mem_text, ed->save.frozen);
+  }
+  _reset(&ed->state, saving);
+  if (ed->save.err != 0) {
+    synced_edit(&ed->synced, ed->save.from.chars); // the file may hold anything after it
+    set_status(ed, st_warn, "save failed: %s", strerror(ed->save.err));
+  } else {
+    for (u32 i = 0; i < ed->save.npoints; i++) { // only those before edits made since hold
+      synced_add(&ed->synced, ed->save.points[i].chars, ed->save.points[i].bytes);
+    }
+    if (ed->save.from.chars > 0) {
+      set_status(ed, st_norm, "%d characters written, first %lld bytes kept.",
+                 ed->save.len - ed->save.from.chars, (long long)ed->save.from.bytes);
+    } else {
+      set_status(ed, st_norm, "%d characters written.", ed->save.len);
+    }
+    watch_sync(ed);
+    diff_invalidate(&ed->diff);
+    ed->watch.offset = ed->save.size;
+    if (ed->rev == ed->save.rev) { // nothing changed while the snapshot was written
+      _reset(&ed->state, unwritten_buffer);
+    }
+  }
+  mem_free(mem_misc, ed->save.points);
+  ed->save = (struct save_job){0};
+  return true;
 }
 
 static void write_to_file(Editor* ed) {
+  if (_has(ed->state, saving)) {
+    set_status(ed, st_warn, "previous save is still in progress.");
+    return;
+  }
+  if (_has(ed->state, stale)) {
+    _reset(&ed->state, stale);
+    set_status(ed, st_warn, "file changed on disk, save again to overwrite.");
+    return;
+  }
   if (_has(ed->state, unwritten_buffer)) {
+    load_finish(ed); // the snapshot has to hold the whole file
+    // the file is only written from the first change on, unless it was touched since
+    struct stat st;
+    struct save_point from = {0};
+    if (ed->fp != NULL && fstat(fileno(ed->fp), &st) == 0 && !_disk_differs(&st, &ed->watch.disk)) {
+      from = synced_resume(&ed->synced, GAP_LEN(&ed->buffer));
+    }
     if (ed->fp == NULL) {
       if (*ed->bufname == '\0') { // obtain filename from user TODO
-        strncpy(ed->bufname, DEFAULT_FILE_NAME, STLEN);
+        set_bufname(ed, DEFAULT_FILE_NAME);
       }
-      ed->fp = fopen(ed->bufname, "w+");
+      ed->fp = fopen(ed->bufname, "w+e");
       if (ed->fp == NULL) {
-        perror("fopen");
+        set_status(ed, st_warn, "fopen: %s", strerror(errno));
+        return;
       }
+      watch_start(ed);
     }
-    rewind(ed->fp);
-    u32 len = GAP_LEN(&ed->buffer);
-    for (u32 i = 0; i < len; i++) {
-      fputwc(gap_get(&ed->buffer, i), ed->fp);
-    }
-    fflush(ed->fp);
-    if (ftruncate(fileno(ed->fp), ftell(ed->fp)) == -1) {
-      perror("ftruncate");
+    ed->save = (struct save_job) {
+      .frozen = ed->buffer.start,
+      .c = ed->buffer.c,
+      .ce = ed->buffer.ce,
+      .end = ed->buffer.end,
+      .rev = ed->rev,
+      .fd = fileno(ed->fp),
+      .len = GAP_LEN(&ed->buffer),
+      .eol = ed->eol,
+      .from = from,
+    };
+    atomic_init(&ed->save.done, false);
+    if (pthread_create(&ed->save.thread, NULL, save_worker, &ed->save) != 0) {
+      set_status(ed, st_warn, "failed to start save worker");
+      ed->save = (struct save_job){0};
+      return;
     }
-    set_status(ed, st_norm, "%d characters written.", len);
-    _reset(&ed->state, unwritten_buffer);
+    _set(&ed->state, saving);
+    synced_edit(&ed->synced, from.chars);
+    ed->synced.dirty = SYNCED_NONE; // the file is going to hold the snapshot
   }
 }
 
-static Editor* editor_init(char* filepath) {
-  Editor* ed = malloc(sizeof(Editor));
-  if (ed == NULL) {
-    perror(__FUNCTION__);
-  }
-  *ed = (Editor){0};
+// sets up an empty buffer and loads filepath into it, if given
+// returns true if filepath was a directory, see open_from_file
+static bool editor_load(Editor* ed, char* filepath, enum modes mode) {
+  ed->mode = mode;
+  ed->watch.fd = -1;
+  ed->viewer.fd = -1;
+  ed->hex.fd = -1;
   ed->tl = timeline_init();
-  ed->buffer = gap_init(INIT_BUFFER_SIZE);
-  ed->lines = gap_init(INIT_BUFFER_SIZE);
+  ed->buffer = gap_init(INIT_BUFFER_SIZE, mem_text);
+  ed->lines = gap_init(INIT_BUFFER_SIZE, mem_lines);
   gap_insert(&ed->lines, 0);
-  ed->pair_stack = u32Da_init(PAIR_STK_SIZE);
+  bracket_init(&ed->brackets);
+  trie_init(&ed->complete.words);
+  synced_init(&ed->synced);
+  ed->pair_stack = u32Da_init(PAIR_STK_SIZE, mem_misc);
 
   _set(&ed->state, blank);
+  bool dir = false;
   if (filepath != NULL) {
-    open_from_file(ed, filepath);
+    dir = open_from_file(ed, filepath);
   } else {
     *ed->bufname = '\0';
   }
-  return ed;
+  if (ed->viewer.fd == -1 && ed->hex.fd == -1) { // nothing to view
+    ed->mode = mode_edit;
+  }
+  return dir;
 }
 
-static void editor_free(Editor** ed) {
-  gap_free(&(*ed)->lines);
-  gap_free(&(*ed)->buffer);
-  timeline_free(&(*ed)->tl);
-  u32Da_free(&(*ed)->pair_stack);
-  if ((*ed)->fp != NULL) {
-    fclose((*ed)->fp);
-  }
-  **ed = (Editor){0};
-  free(*ed);
-  *ed = NULL;
+// releases buffer and everything tied to it. workspace is kept
+static void editor_unload(Editor* ed) {
+  save_finish(ed, true);
+  load_stop(ed);
+  watch_stop(ed);
+  viewer_close(ed);
+  hex_close(ed);
+  gap_free(&ed->lines);
+  fold_free(&ed->folds);
+  wrap_free(&ed->wrap);
+  anchor_free(&ed->anchors);
+  trie_free(&ed->complete.words);
+  synced_free(&ed->synced);
+  bracket_free(&ed->brackets);
+  diff_stop(&ed->diff);
+  gap_free(&ed->buffer);
+  timeline_free(&ed->tl);
+  u32Da_free(&ed->pair_stack);
+  if (ed->fp != NULL) {
+    fclose(ed->fp);
+  }
+  struct workspace* ws = ed->ws;
+  bool resident = ed->resident;
+  *ed = (Editor){0};
+  ed->ws = ws;
+  ed->resident = resident;
+}
+
+// replaces buffer with the file at filepath
+static void editor_open(Editor* ed, char* filepath) {
+  save_finish(ed, true);
+  if (_has(ed->state, unwritten_buffer)) {
+    set_status(ed, st_warn, "save the file before opening another!");
+    return;
+  }
+  editor_unload(ed);
+  editor_load(ed, filepath, mode_edit);
+  if (ed->status.type != st_warn) { // or else it says why the file was not opened
+    set_status(ed, st_norm, "opened %s", filepath);
+  }
 }
 
 static void editor_exit(Editor* ed) {
-  if (!_has(ed->state, unwritten_buffer)) {
-    exit(EXIT_SUCCESS);
+  save_finish(ed, true);
+  if (!_has(ed->state, unwritten_buffer) || (ed->resident && *ed->bufname != '\0')) { // resident files stay unsaved
+    _set(&ed->state, quit);
+    return;
   }
   set_status(ed, st_warn, "save the file before quit!");
 }
 
-static void print_statusln(WINDOW* edwin, Editor* ed, u16 win_w) {
-  mvwchgat(edwin, 0, 0, -1, A_NORMAL, STATLN_PAIR, NULL);
-  u16 x = 1;
-  char* str = "[+]";
-  wattron(edwin, COLOR_PAIR(STATLN_PAIR));
-  if (_has(ed->state, unwritten_buffer)) {
-    mvwprintw(edwin, 0, x, "%s", str);
+// handles a key typed (or replayed) into the buffer
+static void editor_key(Editor* ed, u32 ch) {
+  if (ed->marks.wait != mark_none) {
+    mark_key(ed, ch);
+    return;
   }
-  x += strlen(str);
+  switch (ch) {
+    case KEY_LEFT: curs_mov_left(ed, 1); break;
+    case KEY_RIGHT: curs_mov_right(ed, 1); break;
+    case KEY_UP: curs_mov_up(ed, 1); break;
+    case KEY_DOWN: curs_mov_down(ed, 1); break;
+    case KEY_BACKSPACE: editor_removel(ed); break;
+    case KEY_DC: editor_remover(ed); break;
+    case '\n': editor_insert_newline(ed); break;
+    case '\t': editor_insert(ed, '\t'); break;
+    case CTRL('u'): editor_undo(ed); break;
+    case CTRL('r'): editor_redo(ed) ;break;
+    case CTRL('s'): write_to_file(ed); break;
+    case CTRL('t'): watch_follow_toggle(ed); break;
+    case CTRL('b'): curs_jump_match(ed); break;
+    case CTRL('d'): diff_toggle(ed); break;
+    case CTRL('f'): fold_toggle(ed); break;
+    case CTRL('n'): complete_word(ed); break;
+    case CTRL('o'): mark_begin(ed, mark_set); break;
+    case CTRL('g'): mark_begin(ed, mark_jump); break;
+    case CTRL('q'): editor_exit(ed); break;
+    default:
+      if (ch >= 32)
+        editor_insert(ed, ch);
+      break;
+  }
+}
 
-  if (*ed->bufname == '\0') {
-    str = "scratch buffer";
-  } else {
-    str = ed->bufname;
+#include "finder.c"
+#include "grep.c"
+#include "transform.c"
+#include "pipe.c"
+#include "macro.c"
+#include "palette.c"
+
+// handles work that completed in the background. returns true if a redraw is needed
+static bool editor_tick(Editor* ed) {
+  bool redraw = palette_tick(ed);
+  if (ed->mode == mode_view) return viewer_tick(ed) || redraw;
+  if (ed->mode == mode_hex) return redraw;
+  redraw |= save_finish(ed, false);
+  if (ed->load.active) return load_tick(ed) || redraw; // changes on disk are looked at once loaded
+  redraw |= watch_poll(ed);
+  return redraw;
+}
+
+// how long main loop may wait for events before editor_tick has work of its own (ms).
+// -1 if only keys, a wake_signal of a worker or the watched file can give it some
+static inline i32 editor_poll_interval(Editor* ed) {
+  if (ed->mode != mode_edit) return -1;
+  if (ed->load.active) return load_pending(&ed->load) ? 0 : -1;
+  if (ed->watch.follow) return ed->watch.behind ? 0 : -1;
+  if (ed->watch.pending && !_has(ed->state, saving)) return watch_settle_left(ed); // saving wakes once done
+  return -1;
+}
+
+// inotify instance main loop should wait on, -1 while editor_tick does not read it
+static inline int editor_watch_fd(Editor* ed) {
+  return ed->mode != mode_edit || ed->load.active ? -1 : ed->watch.fd;
+}
+
+// pool workers are shared by every editor of the process, residents of the daemon too
+static Pool* editor_pool = NULL;
+static u32 editor_pool_users = 0;
+
+static Editor* editor_init(char* filepath, enum modes mode, bool resident) {
+  Editor* ed = malloc(sizeof(Editor));
+  struct workspace* ws = malloc(sizeof(struct workspace));
+  if (ed == NULL || ws == NULL) {
+    perror(__FUNCTION__);
+    exit(EXIT_FAILURE);
   }
-  u32 len = clamp(strlen(str), 0, win_w - x);
-  for (u32 i = 0; i < len; i++) {
-    mvwaddch(edwin, 0, x++, str[i]);
+  *ed = (Editor){0};
+  *ws = (struct workspace){0};
+  ed->resident = resident;
+  if (editor_pool_users++ == 0) {
+    editor_pool = pool_init();
   }
-
-  if (ed->status.type != st_nothing) {
-    str = ed->status.msg;
-    len = clamp(strlen(str), 0, win_w - x - 2);
-    x = win_w - len - 1;
-    wattron(edwin, COLOR_PAIR(ed->status.type));
-    for (u32 i = 0; i < len; i++) {
-      mvwaddch(edwin, 0, x++, str[i]);
-    }
-    wattroff(edwin, COLOR_PAIR(ed->status.type));
-    ed->status.type = st_nothing;
+  ws->pool = editor_pool;
+  ws->tty = resident ? -1 : STDIN_FILENO;
+  wake_init();
+  finder_init(&ws->finder);
+  grep_init(&ws->grep);
+  ws->macro.keys = u32Da_init(MACRO_INIT_SIZE, mem_misc);
+  ed->ws = ws;
+  if (editor_load(ed, filepath, mode)) { // files of the directory are picked from palette
+    palette_open(ed);
   }
-  wattroff(edwin, COLOR_PAIR(STATLN_PAIR));
+  return ed;
 }
 
-static void highlight_curs(WINDOW* edwin, u16 cx, u16 cy) {
-  mvwchgat(edwin, cy, 0, LNO_PADDING, A_NORMAL | A_BOLD, TXT_GREEN, NULL);
-  mvwchgat(edwin, cy, cx, 1, A_REVERSE, PAIR_NUMBER(mvwinch(edwin, cy, cx) & A_COLOR), NULL);
+static void editor_free(Editor** ed) {
+  struct workspace* ws = (*ed)->ws;
+  editor_unload(*ed);
+  finder_cancel(&ws->finder);
+  grep_cancel(&ws->grep);
+  pool_wait(ws->pool, &ws->finder.walking); // the pool goes on for other editors
+  pool_wait(ws->pool, &ws->grep.running);
+  if (--editor_pool_users == 0) {
+    pool_free(editor_pool);
+    editor_pool = NULL;
+  }
+  finder_free(&ws->finder);
+  grep_free(&ws->grep);
+  u32Da_free(&ws->macro.keys);
+  mem_log("exit");
+  free(ws);
+  free(*ed);
+  *ed = NULL;
 }
 
 static void editor_draw(WINDOW* edwin, Editor* ed) {
   u16 win_h, win_w;
   getmaxyx(edwin, win_h, win_w);
-  werase(edwin);
 
-  print_statusln(edwin, ed, win_w);
+  if (ed->mode != mode_edit) {
+    werase(edwin);
+    if (ed->mode == mode_hex) {
+      hex_draw(edwin, ed, win_h, win_w);
+    } else {
+      viewer_draw(edwin, ed, win_h, win_w);
+    }
+    if (ed->ws->palette.open) {
+      palette_draw(edwin, ed, win_h, win_w);
+    }
+    return;
+  }
 
   if (_has(ed->state, blank)) {
+    ed->drawn.valid = false;
+    werase(edwin);
+    print_statusln(edwin, ed, win_w);
     display_help(ed, edwin, win_w, win_h);
     wattron(edwin, COLOR_PAIR(COMMENT_PAIR));
     mvwprintw(edwin, 1, 0, "%5d  ", ed->view.y + 1);
     wattroff(edwin, COLOR_PAIR(COMMENT_PAIR));
     highlight_curs(edwin, LNO_PADDING, 1);
+    if (ed->ws->palette.open) {
+      palette_draw(edwin, ed, win_h, win_w);
+    }
     return;
   }
 
   update_view(ed, win_h, win_w);
-  const u16 content_w = win_w - LNO_PADDING;
+  diff_update(ed);
   const u32 visual_cursx = vlen(ed, lnbeg(ed, cursy(ed)), cursi(ed));
 
-  u32 vy = 1;
-  for (; vy < win_h && vy + ed->view.y - 1 < lncount(ed); vy++) {
-    u32 line = vy + ed->view.y - 1;
-    u32 start = lnbeg(ed, line);
-    u32 len = lnlen(ed, line);
-    
-    wattron(edwin, COLOR_PAIR(COMMENT_PAIR));
-    mvwprintw(edwin, vy, 0, "%5d ", line + 1);
-    wattroff(edwin, COLOR_PAIR(COMMENT_PAIR));
-
-    u32 vx = 0;
-    wchar_t wch[2] = {0};
-    cchar_t cchar;
-    for (u32 i = 0; i < len; i++) {
-      *wch = gap_get(&ed->buffer, start + i);
-      u8 char_width = (*wch == '\t') ? tabstop_distance(vx) : wcwidth(*wch);
-
-      if (vx + char_width > ed->view.x && vx < ed->view.x + content_w) {
-        u32 screen_x = vx + LNO_PADDING - ed->view.x;
-        if (*wch == '\t') {
-          for (u32 k = 0; k < char_width; k++) {
-            if (vx + k >= ed->view.x && screen_x + k < win_w) {
-              mvwaddch(edwin, vy, screen_x + k, ' ');
-            }
-          }
-        } else if (screen_x < win_w) {
-          setcchar(&cchar, wch, A_NORMAL, EDITOR_PAIR, NULL);
-          mvwadd_wch(edwin, vy, screen_x, &cchar);
-        }
-      }
-      vx += char_width;
+  if (ed->wrap.on) {
+    werase(edwin);
+    u32 line = ed->view.y, sub = ed->view.sub;
+    for (u16 vy = 1; vy < win_h; line = fold_next(&ed->folds, line), sub = 0) {
+      vy = draw_wrapped(edwin, ed, vy, line, sub, win_h, win_w);
+    }
+  } else if (!draw_scrolled(edwin, ed, win_h, win_w)) {
+    werase(edwin);
+    u32 line = ed->view.y;
+    for (u16 vy = 1; vy < win_h; vy++, line = fold_next(&ed->folds, line)) {
+      draw_row(edwin, ed, vy, line, win_w);
     }
   }
-  if (vy < win_h) {
-    wattron(edwin, COLOR_PAIR(COMMENT_PAIR));
-    mvwprintw(edwin, vy, 0, "      ~");
-    wattroff(edwin, COLOR_PAIR(COMMENT_PAIR));
+  print_statusln(edwin, ed, win_w);
+
+  struct drawn* d = &ed->drawn;
+  d->marked[0] = d->marked[1] = d->marked[2] = cursy(ed);
+  u32 at, match;
+  bool paired;
+  if (curs_bracket(ed, &at, &match, &paired)) {
+    highlight_bracket(edwin, ed, at, paired, win_h, win_w);
+    highlight_bracket(edwin, ed, match, paired, win_h, win_w);
+    d->marked[1] = lnfind(ed, at);
+    d->marked[2] = lnfind(ed, match);
   }
 
-  u16 cy = DELTA(ed->view.y, cursy(ed)) + 1;
+  u16 cy = view_row(ed, cursy(ed));
   u16 cx = visual_cursx - ed->view.x + LNO_PADDING;
+  if (ed->wrap.on) {
+    view_cell(ed, cursy(ed), visual_cursx, win_h, win_w, &cy, &cx);
+  }
   
   highlight_curs(edwin, cx, cy);
+  if (ed->ws->palette.open) {
+    palette_draw(edwin, ed, win_h, win_w);
+    d->valid = false;
+    return;
+  }
+  *d = (struct drawn){ true, win_h, win_w, ed->view.y, ed->view.x, ed->rev, GAP_LEN(&ed->buffer), lncount(ed),
+    ed->folds.rev, { d->marked[0], d->marked[1], d->marked[2] } };
 }
@@ -0,0 +1,313 @@
+#pragma once
+// fuzzy file finder over the working directory.
+// directories are read by tasks on the pool, one task per directory, and the paths they
+// find are merged into a cached list on the main thread. queries are scored in parallel
+// parts; a per path character mask rejects most paths with a few vector operations
+// before the actual scoring runs.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define FINDER_PART_MIN KB(16) // fewest paths scored by a single task
+
+struct walk_task {
+  struct finder* f;
+  char path[]; // relative to the working directory, empty for the directory itself
+};
+
+static inline u8 _fold(u8 ch) { return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch; }
+
+// bit of ch in a path mask. letters have a bit each, other characters share a few
+static inline u32 _mask_bit(u8 ch) {
+  ch = _fold(ch);
+  if (ch >= 'a' && ch <= 'z') return 1u << (ch - 'a');
+  if (ch >= '0' && ch <= '9') return 1u << 26;
+  if (ch == '.') return 1u << 27;
+  if (ch == '/') return 1u << 28;
+  if (ch == '_' || ch == '-') return 1u << 29;
+  if (ch >= 0x80) return 1u << 30;
+  return 1u << 31;
+}
+
+static u32 path_mask(const char* s, usize len) {
+  u32 mask = 0;
+  for (usize i = 0; i < len; i++) {
+    mask |= _mask_bit(s[i]);
+  }
+  return mask;
+}
+
+static inline bool finder_walking(struct finder* f) { return atomic_load(&f->walking) > 0; }
+
+static void _walk_submit(struct finder* f, const char* path, usize len);
+
+static void _walk_dir(void* arg) {
+  struct walk_task* t = arg;
+  struct finder* f = t->f;
+  int fd = -1;
+  DIR* dir = NULL;
+  if (!atomic_load(&f->cancel)) {
+    fd = openat(f->root, *t->path ? t->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    dir = fd == -1 ? NULL : fdopendir(fd);
+  }
+  if (dir != NULL) {
+    char* found = NULL;
+    usize len = 0, cap = 0;
+    char child[PATH_MAX];
+    struct dirent* de;
+    while ((de = readdir(dir)) != NULL && !atomic_load(&f->cancel)) {
+      if (de->d_name[0] == '.') continue; // ., .. and hidden entries
+      int n = *t->path ? snprintf(child, PATH_MAX, "%s/%s", t->path, de->d_name) : snprintf(child, PATH_MAX, "%s", de->d_name);
+      if (n >= PATH_MAX) continue;
+      u8 type = de->d_type;
+      if (type == DT_UNKNOWN || type == DT_LNK) {
+        struct stat st;
+        if (fstatat(dirfd(dir), de->d_name, &st, 0) == -1) continue;
+        if (S_ISDIR(st.st_mode) && type == DT_LNK) continue; // links may form cycles
+        type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+      }
+      if (type == DT_DIR) {
+        _walk_submit(f, child, n);
+      } else if (type == DT_REG) {
+        if (len + n + 1 > cap) {
+          cap = MAX(cap * 2, len + n + 1 + KB(4));
+          char* grown = mem_realloc(mem_finder, found, cap);
+          if (grown == NULL) break;
+          found = grown;
+        }
+        memcpy(found + len, child, n + 1);
+        len += n + 1;
+      }
+    }
+    closedir(dir);
+    if (len > 0) { // hand the paths over to the main thread
+      pthread_mutex_lock(&f->lock);
+      if (f->found_len + len > f->found_cap) {
+        usize cap = MAX(f->found_cap * 2, f->found_len + len);
+        char* grown = mem_realloc(mem_finder, f->found, cap);
+        if (grown != NULL) {
+          f->found = grown;
+          f->found_cap = cap;
+        }
+      }
+      if (f->found_len + len <= f->found_cap) {
+        memcpy(f->found + f->found_len, found, len);
+        f->found_len += len;
+      }
+      pthread_mutex_unlock(&f->lock);
+    }
+    mem_free(mem_finder, found);
+  } else if (fd != -1) {
+    close(fd);
+  }
+  mem_free(mem_finder, t);
+  atomic_fetch_sub(&f->walking, 1);
+  wake_signal(); // paths found or walk done
+}
+
+static void _walk_submit(struct finder* f, const char* path, usize len) {
+  struct walk_task* t = mem_alloc(mem_finder, sizeof(struct walk_task) + len + 1);
+  if (t == NULL) return;
+  t->f = f;
+  memcpy(t->path, path, len + 1);
+  atomic_fetch_add(&f->walking, 1);
+  pool_submit(f->pool, _walk_dir, t, false);
+}
+
+// drops the cached list and walks the working directory again
+static void finder_scan(struct finder* f, Pool* pool) {
+  if (finder_walking(f)) return;
+  if (f->root == -1) {
+    f->root = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (f->root == -1) return;
+  }
+  f->pool = pool;
+  f->count = 0;
+  f->names_len = 0;
+  pthread_mutex_lock(&f->lock);
+  f->found_len = 0;
+  pthread_mutex_unlock(&f->lock);
+  atomic_store(&f->cancel, false);
+  _walk_submit(f, "", 0);
+}
+
+static void finder_init(struct finder* f) {
+  *f = (struct finder){0};
+  f->root = -1;
+  pthread_mutex_init(&f->lock, NULL);
+  atomic_init(&f->walking, 0);
+  atomic_init(&f->cancel, false);
+}
+
+// stops the walk. its tasks have to be waited for with pool_wait before the finder is freed
+static inline void finder_cancel(struct finder* f) { atomic_store(&f->cancel, true); }
+
+static void finder_free(struct finder* f) {
+  pthread_mutex_destroy(&f->lock);
+  if (f->root != -1) {
+    close(f->root);
+  }
+  mem_free(mem_finder, f->found);
+  mem_free(mem_finder, f->names);
+  mem_free(mem_finder, f->offs);
+  mem_free(mem_finder, f->masks);
+  *f = (struct finder){0};
+  f->root = -1;
+}
+
+// moves paths found by the walker tasks into the cached list. returns true if any
+static bool finder_merge(struct finder* f) {
+  pthread_mutex_lock(&f->lock);
+  char* found = f->found;
+  usize len = f->found_len;
+  f->found = NULL;
+  f->found_len = f->found_cap = 0;
+  pthread_mutex_unlock(&f->lock);
+  if (len == 0) return false;
+
+  if (f->names_len + len > f->names_cap) {
+    usize cap = MAX(f->names_cap * 2, f->names_len + len);
+    char* names = mem_realloc(mem_finder, f->names, cap);
+    if (names == NULL) goto done;
+    f->names = names;
+    f->names_cap = cap;
+  }
+  memcpy(f->names + f->names_len, found, len);
+  for (usize at = f->names_len; at < f->names_len + len;) {
+    if (f->count == f->cap) {
+      u32 cap = MAX(f->cap * 2, KB(4));
+      u32* offs = mem_realloc(mem_finder, f->offs, sizeof(u32) * cap);
+      if (offs != NULL) f->offs = offs;
+      u32* masks = mem_realloc(mem_finder, f->masks, sizeof(u32) * cap);
+      if (masks != NULL) f->masks = masks;
+      if (offs == NULL || masks == NULL) break;
+      f->cap = cap;
+    }
+    usize n = strlen(f->names + at);
+    f->offs[f->count] = at;
+    f->masks[f->count] = path_mask(f->names + at, n);
+    f->count++;
+    at += n + 1;
+  }
+  f->names_len += len;
+  done:
+  mem_free(mem_finder, found);
+  return true;
+}
+
+static inline const char* finder_path(struct finder* f, u32 i) { return f->names + f->offs[i]; }
+
+static inline usize finder_path_len(struct finder* f, u32 i) {
+  usize next = i + 1 < f->count ? f->offs[i + 1] : f->names_len;
+  return next - f->offs[i] - 1;
+}
+
+// score of q (folded to lowercase) as a subsequence of s, or -1 if it is not one.
+// the shortest window ending at the first complete match is scored, like fzf v1 does.
+// consecutive matches and matches at the start of a path component or word score more,
+// and matches in the file name are preferred over matches in directory names.
+static i32 fuzzy_score(const char* s, usize len, const char* q, usize qlen) {
+  if (qlen == 0) return 63 - (i32)MIN(len, 63);
+  usize end = 0, qi = 0;
+  for (; end < len; end++) {
+    if (_fold(s[end]) == (u8)q[qi] && ++qi == qlen) break;
+  }
+  if (qi < qlen) return -1;
+  usize start = end;
+  for (qi = qlen - 1; ; start--) { // walk back to the latest possible start
+    if (_fold(s[start]) == (u8)q[qi] && qi-- == 0) break;
+  }
+  usize base = len; // start of the file name
+  while (base > 0 && s[base - 1] != '/') base--;
+  i32 score = 0;
+  isize last = -2;
+  qi = 0;
+  for (usize i = start; i <= end && qi < qlen; i++) {
+    if (_fold(s[i]) != (u8)q[qi]) continue;
+    i32 bonus = 16;
+    if ((isize)i == last + 1) bonus += 12;
+    if (i == 0 || s[i - 1] == '/' || s[i - 1] == '_' || s[i - 1] == '-' || s[i - 1] == '.' || s[i - 1] == ' ') {
+      bonus += 10;
+    } else if (s[i] >= 'A' && s[i] <= 'Z' && s[i - 1] >= 'a' && s[i - 1] <= 'z') {
+      bonus += 8;
+    }
+    if (i >= base) bonus += 6;
+    if (last >= 0) bonus -= MIN(i - last - 1, 8);
+    score += bonus;
+    last = i;
+    qi++;
+  }
+  return score * 64 + 63 - (i32)MIN(len, 63); // shorter paths win ties
+}
+
+struct finder_query {
+  struct finder* f;
+  const char* q;
+  usize qlen;
+  u32 qmask;
+  struct finder_top* tops; // one per part
+};
+
+// keeps the best FINDER_TOP candidates sorted by descending score
+static inline void _top_push(struct finder_top* top, u32 idx, i32 score) {
+  if (top->n == FINDER_TOP && score <= top->score[top->n - 1]) return;
+  u32 i = top->n < FINDER_TOP ? top->n++ : top->n - 1;
+  while (i > 0 && top->score[i - 1] < score) {
+    top->idx[i] = top->idx[i - 1];
+    top->score[i] = top->score[i - 1];
+    i--;
+  }
+  top->idx[i] = idx;
+  top->score[i] = score;
+}
+
+static inline void _score_one(struct finder_query* fq, struct finder_top* top, u32 i) {
+  i32 score = fuzzy_score(finder_path(fq->f, i), finder_path_len(fq->f, i), fq->q, fq->qlen);
+  if (score >= 0) _top_push(top, i, score);
+}
+
+static void _score_part(void* arg, u32 part, usize begin, usize end) {
+  struct finder_query* fq = arg;
+  struct finder_top* top = &fq->tops[part];
+  const u32* masks = fq->f->masks;
+  top->n = 0;
+  usize i = begin;
+#ifdef __SSE2__
+  const __m128i q = _mm_set1_epi32(fq->qmask);
+  for (; i + 4 <= end; i += 4) { // four masks at a time, only full supersets are scored
+    __m128i m = _mm_loadu_si128((const __m128i*)(masks + i));
+    u32 hits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(m, q), q)));
+    while (hits) {
+      _score_one(fq, top, i + __builtin_ctz(hits));
+      hits &= hits - 1;
+    }
+  }
+#endif
+  for (; i < end; i++) {
+    if ((masks[i] & fq->qmask) == fq->qmask) _score_one(fq, top, i);
+  }
+}
+
+// fills top with the best matches of query among the cached paths
+static void finder_query(struct finder* f, Pool* pool, const char* query, struct finder_top* top) {
+  char q[STLEN];
+  usize qlen = 0;
+  for (; query[qlen] != '\0' && qlen < STLEN - 1; qlen++) {
+    q[qlen] = _fold(query[qlen]);
+  }
+  q[qlen] = '\0';
+  u32 parts = pool_parts(pool, f->count, FINDER_PART_MIN);
+  struct finder_top tops[parts];
+  struct finder_query fq = { f, q, qlen, path_mask(q, qlen), tops };
+  pool_for(pool, f->count, FINDER_PART_MIN, _score_part, &fq);
+  top->n = 0;
+  for (u32 p = 0; p < parts; p++) {
+    for (u32 i = 0; i < tops[p].n; i++) {
+      _top_push(top, tops[p].idx[i], tops[p].score[i]);
+    }
+  }
+}
@@ -0,0 +1,98 @@
+#pragma once
+// folding blocks of lines down to their first line, include/fold.h keeps the index.
+// ctrl-f folds the block starting on the cursor line, or unfolds it if it is folded. a
+// block runs up to the line closing the last bracket opened on its first line, which is
+// left visible, or else over the lines indented deeper than its first one. >fold all
+// folds every block starting at the indentation of the cursor line.
+
+// columns of leading whitespace of line, -1 if the line is blank
+static i64 _line_indent(Editor* ed, u32 line) {
+  u32 col = 0;
+  for (u32 i = lnbeg(ed, line), end = lnend(ed, line); i < end; i++) {
+    u32 ch = gap_get(&ed->buffer, i);
+    if (ch == '\t') {
+      col += tabstop_distance(col);
+    } else if (ch == ' ') {
+      col++;
+    } else {
+      return col;
+    }
+  }
+  return -1;
+}
+
+// last line of the block starting at line, line itself if it does not start one
+static u32 _fold_block(Editor* ed, u32 line) {
+  u32 beg = lnbeg(ed, line);
+  for (u32 i = lnend(ed, line); i-- > beg;) {
+    u32 ch = gap_get(&ed->buffer, i), match;
+    if (!is_bracket(ch) || _brk_is_close(ch) || !bracket_match(&ed->brackets, i, &match)) continue;
+    u32 close = lnfind(ed, match);
+    if (close > line) return close - 1;
+  }
+  i64 indent = _line_indent(ed, line);
+  if (indent < 0) return line;
+  u32 last = line;
+  for (u32 i = line + 1; i < lncount(ed); i++) {
+    i64 in = _line_indent(ed, i);
+    if (in < 0) continue; // blank lines inside a block belong to it
+    if (in <= indent) break;
+    last = i;
+  }
+  return last;
+}
+
+static void fold_toggle(Editor* ed) {
+  u32 line = cursy(ed);
+  struct fold* fd = fold_at(&ed->folds, line);
+  if (fd != NULL) {
+    set_status(ed, st_norm, "unfolded %u lines.", fd->last - fd->first);
+    fold_remove(&ed->folds, fd);
+    return;
+  }
+  struct fold add = { line, _fold_block(ed, line), 0 };
+  if (add.last == line) {
+    set_status(ed, st_warn, "no block starts on this line.");
+    return;
+  }
+  fold_merge(&ed->folds, &add, 1);
+  set_status(ed, st_norm, "folded %u lines.", add.last - line);
+}
+
+// folds every block whose first line is indented like the cursor line
+static void fold_all(Editor* ed) {
+  load_finish(ed);
+  i64 indent = _line_indent(ed, cursy(ed));
+  if (indent < 0) {
+    set_status(ed, st_warn, "cursor line is blank.");
+    return;
+  }
+  u32 n = 0, cap = 64;
+  struct fold* add = mem_alloc(mem_folds, sizeof(struct fold) * cap);
+  for (u32 line = 0; add != NULL && line < lncount(ed); line++) {
+    if (_line_indent(ed, line) != indent) continue;
+    u32 last = _fold_block(ed, line);
+    if (last == line) continue;
+    if (n == cap) {
+      cap *= 2;
+      struct fold* grown = mem_realloc(mem_folds, add, sizeof(struct fold) * cap);
+      if (grown == NULL) mem_free(mem_folds, add);
+      add = grown;
+      if (add == NULL) break;
+    }
+    add[n++] = (struct fold){ line, last, 0 };
+    line = last; // nested blocks are hidden anyway
+  }
+  if (add == NULL) {
+    perror("fold_all");
+    exit(-1);
+  }
+  fold_merge(&ed->folds, add, n);
+  mem_free(mem_folds, add);
+  set_status(ed, st_norm, "folded %u blocks.", n);
+}
+
+static void unfold_all(Editor* ed) {
+  set_status(ed, st_norm, "unfolded %u blocks.", ed->folds.n);
+  fold_clear(&ed->folds);
+}
@@ -0,0 +1,269 @@
+#pragma once
+// project wide grep for a literal pattern over the files found by the finder.
+// files are read and searched a chunk at a time in batches on the pool. hits stream back
+// to the main thread as soon as a file is done, so the first ones show up long before
+// the scan ends.
+
+#define GREP_BATCH 32 // files searched by a single task
+#define GREP_MAX_HITS 100000 // search stops after this many hits
+#define GREP_TEXT_MAX 160 // bytes of a hit line that are kept
+#define GREP_BINARY_PEEK KB(8) // files with a nul byte this early are skipped
+#define GREP_CHUNK KB(64) // bytes of a file read at a time
+
+struct grep_task {
+  struct grep* g;
+  u32 gen; // search the task belongs to
+  int root; // directory of the finder paths are relative to
+  u32 n;
+  char paths[]; // n nul separated paths
+};
+
+static inline bool _grep_stale(struct grep* g, u32 gen) {
+  return atomic_load(&g->gen) != gen || atomic_load(&g->found) >= GREP_MAX_HITS;
+}
+
+// appends a hit record (u32 line, path, text) to buf
+static bool _grep_record(char** buf, usize* len, usize* cap, u32 line, const char* path, const byte* text, usize tlen) {
+  usize plen = strlen(path);
+  usize need = *len + sizeof(u32) + plen + 1 + tlen + 1;
+  if (need > *cap) {
+    usize grown_cap = MAX(*cap * 2, need + KB(4));
+    char* grown = mem_realloc(mem_grep, *buf, grown_cap);
+    if (grown == NULL) return false;
+    *buf = grown;
+    *cap = grown_cap;
+  }
+  char* at = *buf + *len;
+  memcpy(at, &line, sizeof(u32));
+  memcpy(at + sizeof(u32), path, plen + 1);
+  memcpy(at + sizeof(u32) + plen + 1, text, tlen);
+  at[sizeof(u32) + plen + 1 + tlen] = '\0';
+  *len = need;
+  return true;
+}
+
+// text of the hit at hit, on the line starting at begin: its first bytes less the indent
+static usize _grep_line(int fd, off_t begin, off_t hit, byte* text) {
+  ssize_t got;
+  for (usize indent = 1; indent > 0; begin += indent) { // past the indent, but not the hit
+    while ((got = pread(fd, text, GREP_TEXT_MAX, begin)) == -1 && errno == EINTR) {}
+    if (got <= 0) return 0;
+    indent = 0;
+    while (indent < (usize)got && begin + (off_t)indent < hit && (text[indent] == ' ' || text[indent] == '\t')) indent++;
+  }
+  const byte* stop = memchr(text, '\n', got);
+  return stop ? stop - text : got;
+}
+
+// searches a single file through buf, recording one hit per matching line. files are
+// read rather than mapped, so that one truncated while it is searched can't fault
+static void _grep_file(struct grep* g, u32 gen, int root, const char* path, byte* buf, char** out, usize* len, usize* cap) {
+  int fd = openat(root, path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return;
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size < (off_t)g->plen || st.st_size == 0) {
+    close(fd);
+    return;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  const byte* pattern = (const byte*)g->pattern;
+  off_t off = 0, begin = 0; // of buf in the file, and of the line the hit is on
+  usize n = 0, counted = 0; // bytes in buf, newlines before counted are counted in line
+  u32 line = 0;
+  bool skip = false, done = false; // skipping the rest of a line with a hit
+  while (!done && off + (off_t)n < st.st_size) {
+    ssize_t got = pread(fd, buf + n, MIN(GREP_CHUNK - n, st.st_size - off - n), off + n);
+    if (got == -1 && errno == EINTR) continue;
+    if (got <= 0) break; // truncated since
+    if (off == 0 && n == 0 && memchr(buf, '\0', MIN(got, GREP_BINARY_PEEK)) != NULL) break;
+    n += got;
+
+    const byte* p = buf;
+    if (skip) {
+      p = memchr(buf, '\n', n);
+      skip = p == NULL;
+      p = skip ? buf + n : p;
+    }
+    while ((p = memchr(p, pattern[0], buf + n - p)) != NULL) {
+      if ((usize)(buf + n - p) < g->plen) break; // if it is one, it goes on in the next chunk
+      if (memcmp(p, pattern, g->plen) != 0) {
+        p++;
+        continue;
+      }
+      for (const byte* nl = buf + counted; (nl = memchr(nl, '\n', p - nl)) != NULL; nl++) {
+        line++;
+        begin = off + (nl - buf) + 1;
+      }
+      counted = p - buf;
+      byte text[GREP_TEXT_MAX];
+      usize tlen = _grep_line(fd, begin, off + counted, text);
+      if (!_grep_record(out, len, cap, line, path, text, tlen)) done = true;
+      if (atomic_fetch_add(&g->found, 1) + 1 >= GREP_MAX_HITS || _grep_stale(g, gen)) done = true;
+      if (done) break;
+      p = memchr(p, '\n', buf + n - p); // one hit per line
+      if (p == NULL) {
+        skip = true;
+        break;
+      }
+    }
+    if (skip) counted = n; // the line goes on past buf, there is no newline left in it
+
+    // the last bytes may start a hit that ends in the next chunk
+    usize keep = skip ? 0 : MIN(n, g->plen - 1);
+    for (const byte* nl = buf + counted; (nl = memchr(nl, '\n', buf + n - keep - nl)) != NULL; nl++) {
+      line++;
+      begin = off + (nl - buf) + 1;
+    }
+    memmove(buf, buf + n - keep, keep);
+    off += n - keep;
+    n = keep;
+    counted = 0;
+  }
+  close(fd);
+}
+
+static void _grep_batch(void* arg) {
+  struct grep_task* t = arg;
+  struct grep* g = t->g;
+  char* out = NULL;
+  usize len = 0, cap = 0;
+  byte* buf = mem_alloc(mem_grep, GREP_CHUNK);
+  const char* path = t->paths;
+  for (u32 i = 0; i < t->n && buf != NULL && !_grep_stale(g, t->gen); i++, path += strlen(path) + 1) {
+    _grep_file(g, t->gen, t->root, path, buf, &out, &len, &cap);
+    atomic_fetch_add(&g->scanned, 1);
+    if (len == 0) continue;
+    pthread_mutex_lock(&g->lock); // hand the hits of this file over right away
+    if (atomic_load(&g->gen) == t->gen && g->incoming_len + len > g->incoming_cap) {
+      usize grown_cap = MAX(g->incoming_cap * 2, g->incoming_len + len);
+      char* grown = mem_realloc(mem_grep, g->incoming, grown_cap);
+      if (grown != NULL) {
+        g->incoming = grown;
+        g->incoming_cap = grown_cap;
+      }
+    }
+    if (atomic_load(&g->gen) == t->gen && g->incoming_len + len <= g->incoming_cap) {
+      memcpy(g->incoming + g->incoming_len, out, len);
+      g->incoming_len += len;
+    }
+    pthread_mutex_unlock(&g->lock);
+    wake_signal();
+    len = 0;
+  }
+  mem_free(mem_grep, buf);
+  mem_free(mem_grep, out);
+  mem_free(mem_grep, t);
+  atomic_fetch_sub(&g->running, 1);
+  wake_signal();
+}
+
+static void grep_init(struct grep* g) {
+  *g = (struct grep){0};
+  pthread_mutex_init(&g->lock, NULL);
+  atomic_init(&g->gen, 0);
+  atomic_init(&g->running, 0);
+  atomic_init(&g->scanned, 0);
+  atomic_init(&g->found, 0);
+}
+
+// abandons the running search. its tasks have to be waited for with pool_wait before grep
+// is freed
+static inline void grep_cancel(struct grep* g) { atomic_fetch_add(&g->gen, 1); }
+
+static void grep_free(struct grep* g) {
+  pthread_mutex_destroy(&g->lock);
+  mem_free(mem_grep, g->incoming);
+  mem_free(mem_grep, g->hits);
+  mem_free(mem_grep, g->text);
+  *g = (struct grep){0};
+}
+
+static void grep_start(struct grep* g, const char* pattern) {
+  grep_cancel(g);
+  strncpy(g->pattern, pattern, STLEN - 1);
+  g->plen = strlen(g->pattern);
+  g->next = 0;
+  g->nhits = 0;
+  g->text_len = 0;
+  g->active = true;
+  atomic_store(&g->scanned, 0);
+  atomic_store(&g->found, 0);
+  pthread_mutex_lock(&g->lock);
+  g->incoming_len = 0;
+  pthread_mutex_unlock(&g->lock);
+}
+
+static inline const char* grep_path(struct grep* g, u32 i) { return g->text + g->hits[i].path; }
+static inline const char* grep_text(struct grep* g, u32 i) { return g->text + g->hits[i].text; }
+
+// copies str into the text of merged hits and returns its offset
+static bool _grep_keep(struct grep* g, const char* str, u32* off) {
+  usize n = strlen(str) + 1;
+  if (g->text_len + n > g->text_cap) {
+    usize cap = MAX(g->text_cap * 2, g->text_len + n + KB(16));
+    char* text = mem_realloc(mem_grep, g->text, cap);
+    if (text == NULL) return false;
+    g->text = text;
+    g->text_cap = cap;
+  }
+  memcpy(g->text + g->text_len, str, n);
+  *off = g->text_len;
+  g->text_len += n;
+  return true;
+}
+
+// hands out files found so far and merges streamed hits. returns true if hits changed
+static bool grep_tick(struct grep* g, struct finder* f, Pool* pool) {
+  if (!g->active) return false;
+  u32 gen = atomic_load(&g->gen);
+  while (g->next < f->count && atomic_load(&g->found) < GREP_MAX_HITS) {
+    u32 n = MIN(GREP_BATCH, f->count - g->next);
+    usize size = 0;
+    for (u32 i = 0; i < n; i++) {
+      size += finder_path_len(f, g->next + i) + 1;
+    }
+    struct grep_task* t = mem_alloc(mem_grep, sizeof(struct grep_task) + size);
+    if (t == NULL) break;
+    *t = (struct grep_task){ g, gen, f->root, n };
+    memcpy(t->paths, finder_path(f, g->next), size); // paths of a batch are contiguous
+    atomic_fetch_add(&g->running, 1);
+    pool_submit(pool, _grep_batch, t, false);
+    g->next += n;
+  }
+
+  pthread_mutex_lock(&g->lock);
+  char* incoming = g->incoming;
+  usize len = g->incoming_len;
+  g->incoming = NULL;
+  g->incoming_len = g->incoming_cap = 0;
+  pthread_mutex_unlock(&g->lock);
+  for (usize at = 0; at < len;) {
+    struct grep_hit hit;
+    memcpy(&hit.line, incoming + at, sizeof(u32));
+    const char* path = incoming + at + sizeof(u32);
+    const char* text = path + strlen(path) + 1;
+    at = text + strlen(text) + 1 - incoming;
+    if (g->nhits == g->cap) {
+      u32 cap = MAX(g->cap * 2, KB(1));
+      struct grep_hit* hits = mem_realloc(mem_grep, g->hits, sizeof(struct grep_hit) * cap);
+      if (hits == NULL) break;
+      g->hits = hits;
+      g->cap = cap;
+    }
+    // consecutive hits of a file share its path
+    if (g->nhits > 0 && strcmp(grep_path(g, g->nhits - 1), path) == 0) {
+      hit.path = g->hits[g->nhits - 1].path;
+    } else if (!_grep_keep(g, path, &hit.path)) {
+      break;
+    }
+    if (!_grep_keep(g, text, &hit.text)) break;
+    g->hits[g->nhits++] = hit;
+  }
+  mem_free(mem_grep, incoming);
+
+  g->active = atomic_load(&g->running) > 0 || finder_walking(f) || g->next < f->count;
+  if (atomic_load(&g->found) >= GREP_MAX_HITS) {
+    g->active = atomic_load(&g->running) > 0;
+  }
+  return len > 0 || !g->active;
+}
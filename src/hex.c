@@ -0,0 +1,256 @@
+#pragma once
+// hex view of binary files. the whole file is mapped and drawn straight from its bytes
+// as offset, hex and text columns, nothing is decoded into buffer. bytes are overwritten
+// in place: typed values are kept as sparse patches over the mapping, and saving writes
+// back just the pages holding a patch. files with a NUL byte near their start open in
+// hex mode, as does any file given with -x.
+
+#define HEX_PEEK KB(8) // bytes looked at for a NUL when opening a file
+#define HEX_ROW 16 // bytes per row, halved on narrow windows
+
+// true if the file at path looks binary
+static bool hex_sniff(const char* path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return false;
+  byte peek[HEX_PEEK];
+  ssize_t got = pread(fd, peek, HEX_PEEK, 0);
+  close(fd);
+  return got > 0 && memchr(peek, '\0', got) != NULL;
+}
+
+// opens filepath in hex mode. returns false, with a warning in status, if it can't be
+static bool hex_open(Editor* ed, const char* filepath) {
+  struct hex* h = &ed->hex;
+  h->writable = true;
+  h->fd = open(filepath, O_RDWR | O_CLOEXEC);
+  if (h->fd == -1) {
+    h->writable = false;
+    h->fd = open(filepath, O_RDONLY | O_CLOEXEC);
+  }
+  struct stat st;
+  if (h->fd == -1 || fstat(h->fd, &st) == -1) {
+    set_status(ed, st_warn, "open: %s", strerror(errno));
+    goto failed;
+  }
+  h->size = st.st_size;
+  h->per = HEX_ROW;
+  if (h->size > 0) { // shared, so bytes written back show up in the mapping
+    void* map = mmap(NULL, h->size, PROT_READ, MAP_SHARED, h->fd, 0);
+    if (map == MAP_FAILED) {
+      set_status(ed, st_warn, "mmap: %s", strerror(errno));
+      goto failed;
+    }
+    h->map = map;
+  }
+  ed->mode = mode_hex;
+  _reset(&ed->state, blank);
+  return true;
+
+  failed:
+  if (h->fd != -1) close(h->fd);
+  *h = (struct hex){0};
+  h->fd = -1;
+  return false;
+}
+
+static void hex_close(Editor* ed) {
+  struct hex* h = &ed->hex;
+  if (h->fd == -1) return;
+  if (h->map != NULL) {
+    munmap((void*)h->map, h->size);
+  }
+  mem_free(mem_misc, h->patches);
+  close(h->fd);
+  *h = (struct hex){0};
+  h->fd = -1;
+}
+
+// index of the first patch at or after off
+static u32 _hex_find(const struct hex* h, u64 off) {
+  u32 lo = 0, hi = h->npatches;
+  while (lo < hi) {
+    u32 mid = lo + (hi - lo) / 2;
+    if (h->patches[mid].off < off) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// byte at off as patched, patched is set if it differs from the file
+static inline byte hex_byte(const struct hex* h, u64 off, bool* patched) {
+  u32 k = _hex_find(h, off);
+  *patched = k < h->npatches && h->patches[k].off == off;
+  return *patched ? h->patches[k].val : h->map[off];
+}
+
+// sets byte at off to val. a byte set back to what the file holds drops its patch
+static void _hex_set(Editor* ed, u64 off, byte val) {
+  struct hex* h = &ed->hex;
+  u32 k = _hex_find(h, off);
+  bool found = k < h->npatches && h->patches[k].off == off;
+  if (val == h->map[off]) {
+    if (found) {
+      memmove(h->patches + k, h->patches + k + 1, sizeof(struct hex_patch) * (h->npatches - k - 1));
+      h->npatches--;
+    }
+  } else if (found) {
+    h->patches[k].val = val;
+  } else {
+    if (h->npatches == h->cap) {
+      u32 cap = h->cap == 0 ? 64 : h->cap * 2;
+      struct hex_patch* grown = mem_realloc(mem_misc, h->patches, sizeof(struct hex_patch) * cap);
+      if (grown == NULL) {
+        perror("hex patch");
+        exit(-1);
+      }
+      h->patches = grown;
+      h->cap = cap;
+    }
+    memmove(h->patches + k + 1, h->patches + k, sizeof(struct hex_patch) * (h->npatches - k));
+    h->patches[k] = (struct hex_patch){ off, val };
+    h->npatches++;
+  }
+  if (h->npatches > 0) {
+    _set(&ed->state, unwritten_buffer);
+  } else {
+    _reset(&ed->state, unwritten_buffer);
+  }
+}
+
+// writes every page holding a patch back to the file
+static void hex_save(Editor* ed) {
+  struct hex* h = &ed->hex;
+  if (!h->writable) {
+    set_status(ed, st_warn, "file is read-only.");
+    return;
+  } else if (h->npatches == 0) {
+    set_status(ed, st_norm, "nothing to write.");
+    return;
+  }
+  u64 page = sysconf(_SC_PAGESIZE);
+  byte* out = mem_alloc(mem_io, page);
+  if (out == NULL) {
+    set_status(ed, st_warn, "failed to write: %s", strerror(ENOMEM));
+    return;
+  }
+  u32 pages = 0;
+  for (u32 k = 0; k < h->npatches;) {
+    u64 at = h->patches[k].off / page * page, len = MIN(page, h->size - at);
+    memcpy(out, h->map + at, len);
+    for (; k < h->npatches && h->patches[k].off < at + len; k++) {
+      out[h->patches[k].off - at] = h->patches[k].val;
+    }
+    for (u64 w = 0; w < len;) {
+      ssize_t res = pwrite(h->fd, out + w, len - w, at + w);
+      if (res == -1 && errno == EINTR) continue;
+      if (res == -1) {
+        mem_free(mem_io, out);
+        set_status(ed, st_warn, "failed to write: %s", strerror(errno));
+        return; // patches not written yet are kept
+      }
+      w += res;
+    }
+    pages++;
+  }
+  mem_free(mem_io, out);
+  set_status(ed, st_norm, "%u bytes written in %u pages.", h->npatches, pages);
+  h->npatches = 0;
+  _reset(&ed->state, unwritten_buffer);
+}
+
+static void hex_mov(Editor* ed, i64 bytes) {
+  struct hex* h = &ed->hex;
+  h->curs = clamp((i64)h->curs + bytes, 0, h->size > 0 ? (i64)h->size - 1 : 0);
+  h->low = false;
+}
+
+// value of the hex digit ch, -1 if it is none
+static inline i32 _hex_digit(u32 ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  return -1;
+}
+
+// overwrites the byte under cursor with a typed hex digit, or a character in text column
+static void _hex_type(Editor* ed, u32 ch) {
+  struct hex* h = &ed->hex;
+  if (h->size == 0) return;
+  bool patched;
+  byte old = hex_byte(h, h->curs, &patched);
+  if (h->text) {
+    if (ch < 32 || ch > 126) return;
+    _hex_set(ed, h->curs, ch);
+    hex_mov(ed, 1);
+    return;
+  }
+  i32 digit = _hex_digit(ch);
+  if (digit < 0) return;
+  _hex_set(ed, h->curs, h->low ? (old & 0xf0) | digit : (old & 0x0f) | digit << 4);
+  if (h->low) {
+    hex_mov(ed, 1);
+  } else {
+    h->low = true;
+  }
+}
+
+static void hex_key(Editor* ed, u32 ch) {
+  struct hex* h = &ed->hex;
+  i64 page = (i64)h->per * MAX(LINES - 1, 1);
+  switch (ch) {
+    case KEY_LEFT: hex_mov(ed, -1); break;
+    case KEY_RIGHT: hex_mov(ed, 1); break;
+    case KEY_UP: hex_mov(ed, -(i64)h->per); break;
+    case KEY_DOWN: hex_mov(ed, h->per); break;
+    case KEY_PPAGE: hex_mov(ed, -page); break;
+    case KEY_NPAGE: hex_mov(ed, page); break;
+    case KEY_HOME: hex_mov(ed, -(i64)h->curs); break;
+    case KEY_END: hex_mov(ed, h->size); break;
+    case '\t': h->text = !h->text; h->low = false; break;
+    case CTRL('s'): hex_save(ed); break;
+    case CTRL('u'):
+      if (h->size > 0) {
+        _hex_set(ed, h->curs, h->map[h->curs]);
+        set_status(ed, st_norm, "byte reverted to file.");
+      }
+      break;
+    default: _hex_type(ed, ch); break;
+  }
+}
+
+static void hex_draw(WINDOW* edwin, Editor* ed, u16 win_h, u16 win_w) {
+  struct hex* h = &ed->hex;
+  u8 digits = h->size > 0xffffffffULL ? 12 : 8;
+  h->per = digits + 2 + HEX_ROW * 4 + 1 <= win_w ? HEX_ROW : HEX_ROW / 2;
+  u64 rows = MAX(win_h - 1, 1), row = h->curs / h->per;
+  if (row < h->top) h->top = row;
+  if (row >= h->top + rows) h->top = row - rows + 1;
+  print_statusln(edwin, ed, win_w);
+
+  u16 text_x = digits + 2 + h->per * 3 + 1;
+  for (u32 vy = 1; vy < win_h; vy++) {
+    u64 off = (h->top + vy - 1) * h->per;
+    if (off >= h->size) break;
+    wattron(edwin, COLOR_PAIR(COMMENT_PAIR));
+    mvwprintw(edwin, vy, 0, "%0*llx", digits, (unsigned long long)off);
+    wattroff(edwin, COLOR_PAIR(COMMENT_PAIR));
+    for (u32 i = 0; i < h->per && off + i < h->size && text_x + i < win_w; i++) {
+      bool patched;
+      byte b = hex_byte(h, off + i, &patched);
+      attr_t attr = patched ? A_BOLD | COLOR_PAIR(STATLN_WARN_PAIR) : A_NORMAL;
+      wattron(edwin, attr);
+      mvwprintw(edwin, vy, digits + 2 + i * 3, "%02x", b);
+      mvwaddch(edwin, vy, text_x + i, b >= 32 && b < 127 ? b : '.');
+      wattroff(edwin, attr);
+    }
+  }
+  if (h->size == 0) return;
+  u16 cy = h->curs / h->per - h->top + 1, col = h->curs % h->per;
+  u16 cx = h->text ? text_x + col : digits + 2 + col * 3 + h->low;
+  if (cx < win_w) {
+    mvwchgat(edwin, cy, cx, 1, A_REVERSE, PAIR_NUMBER(mvwinch(edwin, cy, cx) & A_COLOR), NULL);
+  }
+}
@@ -0,0 +1,177 @@
+#pragma once
+// positions in text that follow its edits. anchors are kept in a treap ordered by
+// position, where an edit only splits off the anchors after it and tags that subtree
+// with a shift, or with collapsing onto the start of a removed range. tags are pushed
+// down lazily on the way to a node, so an edit costs O(log n) whatever the number of
+// anchors it moves. anchors are named by ids that stay valid until dropped.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "itypes.h"
+#include "mem.h"
+
+#define ANCHOR_NONE 0 // node 0 is never used, ids start at 1
+
+struct anchor_node {
+  u32 pos; // up to date once the tags of its ancestors are pushed down
+  u32 prio;
+  u32 left, right, parent; // parent is the next free node once dropped
+  u32 set, add; // tag for the subtree below: positions are set to set if collapse, then add is added
+  bool collapse;
+};
+
+struct anchors {
+  struct anchor_node* v;
+  u32 n, cap; // nodes used, including dropped ones
+  u32 root, free;
+  u32 seed;
+};
+
+static void anchor_free(struct anchors* a) {
+  mem_free(mem_anchors, a->v);
+  *a = (struct anchors){0};
+}
+
+static inline void _anchor_tag(struct anchors* a, u32 node, bool collapse, u32 set, u32 add) {
+  if (node == ANCHOR_NONE) return;
+  struct anchor_node* nd = &a->v[node];
+  nd->pos = (collapse ? set : nd->pos) + add; // wraps around for negative shifts
+  if (collapse) {
+    nd->collapse = true;
+    nd->set = set;
+    nd->add = add;
+  } else {
+    nd->add += add;
+  }
+}
+
+static inline void _anchor_push(struct anchors* a, u32 node) {
+  struct anchor_node* nd = &a->v[node];
+  if (!nd->collapse && nd->add == 0) return;
+  _anchor_tag(a, nd->left, nd->collapse, nd->set, nd->add);
+  _anchor_tag(a, nd->right, nd->collapse, nd->set, nd->add);
+  nd->collapse = false;
+  nd->add = 0;
+}
+
+static inline void _anchor_adopt(struct anchors* a, u32 node) {
+  if (a->v[node].left != ANCHOR_NONE) a->v[a->v[node].left].parent = node;
+  if (a->v[node].right != ANCHOR_NONE) a->v[a->v[node].right].parent = node;
+}
+
+// splits node into anchors before pos (or at it too, if inclusive) and the rest
+static void _anchor_split(struct anchors* a, u32 node, u32 pos, bool inclusive, u32* l, u32* r) {
+  if (node == ANCHOR_NONE) {
+    *l = *r = ANCHOR_NONE;
+    return;
+  }
+  _anchor_push(a, node);
+  struct anchor_node* nd = &a->v[node];
+  if (nd->pos < pos || (inclusive && nd->pos == pos)) {
+    _anchor_split(a, nd->right, pos, inclusive, &a->v[node].right, r);
+    *l = node;
+  } else {
+    _anchor_split(a, nd->left, pos, inclusive, l, &a->v[node].left);
+    *r = node;
+  }
+  _anchor_adopt(a, node);
+}
+
+// joins two treaps, every anchor of l being at or before those of r
+static u32 _anchor_merge(struct anchors* a, u32 l, u32 r) {
+  if (l == ANCHOR_NONE) return r;
+  if (r == ANCHOR_NONE) return l;
+  if (a->v[l].prio > a->v[r].prio) {
+    _anchor_push(a, l);
+    a->v[l].right = _anchor_merge(a, a->v[l].right, r);
+    _anchor_adopt(a, l);
+    return l;
+  }
+  _anchor_push(a, r);
+  a->v[r].left = _anchor_merge(a, l, a->v[r].left);
+  _anchor_adopt(a, r);
+  return r;
+}
+
+static inline void _anchor_root(struct anchors* a, u32 root) {
+  a->root = root;
+  if (root != ANCHOR_NONE) a->v[root].parent = ANCHOR_NONE;
+}
+
+// adds an anchor at pos, returns its id
+static u32 anchor_add(struct anchors* a, u32 pos) {
+  u32 id = a->free;
+  if (id != ANCHOR_NONE) {
+    a->free = a->v[id].parent;
+  } else {
+    if (a->n + 1 >= a->cap) {
+      u32 cap = a->cap == 0 ? 16 : a->cap * 2;
+      struct anchor_node* grown = mem_realloc(mem_anchors, a->v, sizeof(struct anchor_node) * cap);
+      if (grown == NULL) {
+        perror("anchor_add");
+        exit(-1);
+      }
+      a->v = grown;
+      a->cap = cap;
+    }
+    id = ++a->n;
+  }
+  a->seed = a->seed * 1664525 + 1013904223;
+  a->v[id] = (struct anchor_node){ .pos = pos, .prio = a->seed };
+  u32 l, r;
+  _anchor_split(a, a->root, pos, true, &l, &r);
+  _anchor_root(a, _anchor_merge(a, _anchor_merge(a, l, id), r));
+  return id;
+}
+
+// brings the position of node up to date by pushing down the tags above it
+static void _anchor_settle(struct anchors* a, u32 node) {
+  u32 parent = a->v[node].parent;
+  if (parent == ANCHOR_NONE) return;
+  _anchor_settle(a, parent);
+  _anchor_push(a, parent);
+}
+
+static u32 anchor_pos(struct anchors* a, u32 id) {
+  _anchor_settle(a, id);
+  return a->v[id].pos;
+}
+
+static void anchor_drop(struct anchors* a, u32 id) {
+  _anchor_settle(a, id);
+  _anchor_push(a, id);
+  struct anchor_node* nd = &a->v[id];
+  u32 joined = _anchor_merge(a, nd->left, nd->right), parent = nd->parent;
+  if (parent == ANCHOR_NONE) {
+    _anchor_root(a, joined);
+  } else {
+    if (a->v[parent].left == id) {
+      a->v[parent].left = joined;
+    } else {
+      a->v[parent].right = joined;
+    }
+    if (joined != ANCHOR_NONE) a->v[joined].parent = parent;
+  }
+  nd->parent = a->free;
+  a->free = id;
+}
+
+// follows n characters inserted at pos. anchors at pos stay before them
+static void anchor_insert(struct anchors* a, u32 pos, u32 n) {
+  if (a->root == ANCHOR_NONE || n == 0) return;
+  u32 l, r;
+  _anchor_split(a, a->root, pos, true, &l, &r);
+  _anchor_tag(a, r, false, 0, n);
+  _anchor_root(a, _anchor_merge(a, l, r));
+}
+
+// follows the removal of [from, to). anchors inside it end up at from
+static void anchor_remove(struct anchors* a, u32 from, u32 to) {
+  if (a->root == ANCHOR_NONE || from >= to) return;
+  u32 l, mid, r;
+  _anchor_split(a, a->root, from, false, &l, &r);
+  _anchor_split(a, r, to, false, &mid, &r);
+  _anchor_tag(a, mid, true, from, 0);
+  _anchor_tag(a, r, false, 0, from - to);
+  _anchor_root(a, _anchor_merge(a, _anchor_merge(a, l, mid), r));
+}
@@ -0,0 +1,161 @@
+#pragma once
+// folded line ranges. a fold keeps its first line on screen and hides the ones after it
+// up to last. folds never overlap and are kept sorted, each one knowing how many lines
+// the folds before it hide. so converting between line numbers and rows on screen is a
+// binary search over the folds, whatever number of lines they hide.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "itypes.h"
+#include "mem.h"
+#include "utils.h"
+
+struct fold {
+  u32 first, last;
+  u32 before; // lines hidden by the folds before this one
+};
+
+struct folds {
+  struct fold* v;
+  u32 n;
+  u32 rev; // incremented whenever folds are added or dropped
+};
+
+static void fold_free(struct folds* f) {
+  mem_free(mem_folds, f->v);
+  *f = (struct folds){0};
+}
+
+// drops every fold
+static void fold_clear(struct folds* f) {
+  mem_free(mem_folds, f->v);
+  f->v = NULL;
+  f->n = 0;
+  f->rev++;
+}
+
+static void _fold_settle(struct folds* f) {
+  u32 hidden = 0;
+  for (u32 i = 0; i < f->n; i++) {
+    f->v[i].before = hidden;
+    hidden += f->v[i].last - f->v[i].first;
+  }
+  f->rev++;
+}
+
+// number of folds starting before line
+static u32 _fold_search(const struct folds* f, u32 line) {
+  u32 lo = 0, hi = f->n;
+  while (lo < hi) {
+    u32 mid = lo + (hi - lo) / 2;
+    if (f->v[mid].first < line) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// true if line is hidden by a fold
+static inline bool fold_hidden(const struct folds* f, u32 line) {
+  u32 k = _fold_search(f, line);
+  return k > 0 && line <= f->v[k - 1].last;
+}
+
+// the fold starting at line, or NULL
+static inline struct fold* fold_at(const struct folds* f, u32 line) {
+  u32 k = _fold_search(f, line);
+  return k < f->n && f->v[k].first == line ? &f->v[k] : NULL;
+}
+
+// screen row of line, counted from the first line. hidden lines share the row of their fold
+static u32 fold_row(const struct folds* f, u32 line) {
+  u32 k = _fold_search(f, line);
+  if (k == 0) return line;
+  const struct fold* fd = &f->v[k - 1];
+  return line - fd->before - (MIN(line, fd->last) - fd->first);
+}
+
+// line shown at screen row
+static u32 fold_line(const struct folds* f, u32 row) {
+  u32 lo = 0, hi = f->n; // folds starting at or before row
+  while (lo < hi) {
+    u32 mid = lo + (hi - lo) / 2;
+    if (f->v[mid].first - f->v[mid].before <= row) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) return row;
+  const struct fold* fd = &f->v[lo - 1];
+  u32 header = fd->first - fd->before;
+  return row == header ? fd->first : row + fd->before + (fd->last - fd->first);
+}
+
+// line shown on the row after line
+static inline u32 fold_next(const struct folds* f, u32 line) {
+  const struct fold* fd = fold_at(f, line);
+  return fd != NULL ? fd->last + 1 : line + 1;
+}
+
+// adds n sorted folds. a fold inside another one is left out, as is one overlapping a
+// fold before it
+static void fold_merge(struct folds* f, const struct fold* add, u32 n) {
+  if (n == 0) return;
+  struct fold* out = mem_alloc(mem_folds, sizeof(struct fold) * (f->n + n));
+  if (out == NULL) {
+    perror("fold_merge");
+    exit(-1);
+  }
+  u32 i = 0, j = 0, len = 0;
+  while (i < f->n || j < n) {
+    const struct fold* next;
+    if (j == n || (i < f->n && (f->v[i].first < add[j].first ||
+        (f->v[i].first == add[j].first && f->v[i].last >= add[j].last)))) {
+      next = &f->v[i++];
+    } else {
+      next = &add[j++];
+    }
+    if (len > 0 && next->first <= out[len - 1].last) continue;
+    out[len++] = *next;
+  }
+  mem_free(mem_folds, f->v);
+  f->v = out;
+  f->n = len;
+  _fold_settle(f);
+}
+
+static void fold_remove(struct folds* f, struct fold* fd) {
+  u32 k = fd - f->v;
+  memmove(f->v + k, f->v + k + 1, sizeof(struct fold) * (f->n - k - 1));
+  f->n--;
+  _fold_settle(f);
+}
+
+// unfolds the fold hiding line, if any
+static void fold_reveal(struct folds* f, u32 line) {
+  u32 k = _fold_search(f, line);
+  if (k > 0 && line <= f->v[k - 1].last) fold_remove(f, &f->v[k - 1]);
+}
+
+// follows an edit that replaced lines [line, line + removed] by [line, line + added].
+// folds the edit touched are dropped, the ones after it move along
+static void fold_edit(struct folds* f, u32 line, u32 removed, u32 added) {
+  if (f->n == 0 || (removed == 0 && added == 0)) return;
+  u32 k = _fold_search(f, line + removed + 1), kept = 0; // folds after k start past the edit
+  for (u32 i = 0; i < k; i++) {
+    if (f->v[i].last < line) f->v[kept++] = f->v[i];
+  }
+  for (u32 i = k; i < f->n; i++) {
+    f->v[i].first = f->v[i].first + added - removed;
+    f->v[i].last = f->v[i].last + added - removed;
+    f->v[kept++] = f->v[i];
+  }
+  if (kept != f->n) {
+    f->n = kept;
+    _fold_settle(f);
+  }
+}
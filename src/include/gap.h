@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "itypes.h"
+#include "mem.h"
 
 #define _RESIZE_FAC 1.6
 
@@ -14,6 +15,7 @@ typedef struct {
   u32 c;  // offset to start of gap or cursor
   u32 ce;  // offset to end of gap
   u32 capacity;  // total capacity of gap buffer. can grow
+  enum mem_tag tag;  // memory accounted to
 } GapBuffer;
 
 // expands to give the width of gap in gap buffer
@@ -31,9 +33,10 @@ typedef struct {
 #define GAP_GET_LOGICAL_INDEX(gap, buffer_index) (((buffer_index) > (gap)->ce) ? (buffer_index) + (gap)->c - (gap)->ce - 1 : (buffer_index))
 
 // initialize gap buffer of capacity = size
-static GapBuffer gap_init(u32 size) {
+static GapBuffer gap_init(u32 size, enum mem_tag tag) {
   GapBuffer gap = {0};
-  gap.start = (u32*)malloc(sizeof(u32) * size);
+  gap.tag = tag;
+  gap.start = (u32*)mem_alloc(tag, sizeof(u32) * size);
   if (gap.start == NULL) {
     perror("failed to initialize gap buffer.");
     exit(-1);
@@ -45,7 +48,7 @@ static GapBuffer gap_init(u32 size) {
 
 // frees gap buffer
 static void gap_free(GapBuffer* gap) {
-  free(gap->start);
+  mem_free(gap->tag, gap->start);
   gap->start = NULL;
   gap->end = gap->c = gap->ce = gap->capacity = 0;
 }
@@ -54,7 +57,7 @@ static void gap_free(GapBuffer* gap) {
 static void gap_grow(GapBuffer* gap) {
   isize ce_offset = gap->end - gap->ce;
   gap->capacity *= _RESIZE_FAC;
-  gap->start = (u32*)realloc(gap->start, sizeof(u32) * gap->capacity);
+  gap->start = (u32*)mem_realloc(gap->tag, gap->start, sizeof(u32) * gap->capacity);
   if (!gap->start) {
     perror("realloc failure");
     exit(-1);
@@ -76,27 +79,69 @@ static void gap_insert(GapBuffer* gap, u32 ch) {
   gap->c++;
 }
 
+// inserts n elements at the cursor, growing the gap at most once
+static void gap_insert_n(GapBuffer* gap, const u32* src, u32 n) {
+  if (GAP_WIDTH(gap) <= n) {
+    isize ce_offset = gap->end - gap->ce;
+    gap->capacity = gap->capacity * _RESIZE_FAC + n;
+    gap->start = (u32*)mem_realloc(gap->tag, gap->start, sizeof(u32) * gap->capacity);
+    if (!gap->start) {
+      perror("realloc failure");
+      exit(-1);
+    }
+    gap->end = gap->capacity - 1;
+    if (ce_offset > 0) {
+      memmove(gap->start + gap->end - ce_offset + 1, gap->start + gap->ce + 1, sizeof(u32) * ce_offset);
+    }
+    gap->ce = gap->end - ce_offset;
+  }
+  memcpy(gap->start + gap->c, src, sizeof(u32) * n);
+  gap->c += n;
+}
+
+// appends n elements after the last element. the gap and the cursor stays where it is,
+// so the storage may end with unused capacity after `end`.
+static void gap_append_n(GapBuffer* gap, const u32* src, u32 n) {
+  if (gap->end + n >= gap->capacity) {
+    gap->capacity = gap->capacity * _RESIZE_FAC + n;
+    gap->start = (u32*)mem_realloc(gap->tag, gap->start, sizeof(u32) * gap->capacity);
+    if (!gap->start) {
+      perror("realloc failure");
+      exit(-1);
+    }
+  }
+  memcpy(gap->start + gap->end + 1, src, sizeof(u32) * n);
+  gap->end += n;
+}
+
+// makes room for n more elements after `end`, so appending them does not grow again
+static void gap_reserve(GapBuffer* gap, u32 n) {
+  if (gap->end + n < gap->capacity) return;
+  u32* start = (u32*)mem_realloc(gap->tag, gap->start, sizeof(u32) * ((usize)gap->end + n + 1));
+  if (start == NULL) return; // appending grows it instead
+  gap->start = start;
+  gap->capacity = gap->end + n + 1;
+}
+
 // remove from left operation
 static void gap_remove(GapBuffer* gap) { if (gap->c > 0) gap->c--; }
 
 // moves the gap max `n_ch` times to the left
 static void gap_left(GapBuffer* gap, u32 times) {
-  while (times > 0 && gap->c > 0) {
-    *(gap->start + gap->ce) = *(gap->start + gap->c - 1);
-    gap->ce--;
-    gap->c--;
-    times--;
-  }
+  u32 n = times < gap->c ? times : gap->c;
+  if (n == 0) return;
+  memmove(gap->start + gap->ce + 1 - n, gap->start + gap->c - n, sizeof(u32) * n);
+  gap->ce -= n;
+  gap->c -= n;
 }
 
 // moves the gap max `n_ch` times to the right
 static void gap_right(GapBuffer* gap, u32 times) {
-  while (times > 0 && gap->ce < gap->end) {
-    *(gap->start + gap->c) = *(gap->start + gap->ce + 1);
-    gap->ce++;
-    gap->c++;
-    times--;
-  }
+  u32 n = times < gap->end - gap->ce ? times : gap->end - gap->ce;
+  if (n == 0) return;
+  memmove(gap->start + gap->c, gap->start + gap->ce + 1, sizeof(u32) * n);
+  gap->ce += n;
+  gap->c += n;
 }
 
 // move gap to specified pos
@@ -115,6 +160,13 @@ static u32 gap_get(const GapBuffer* gap, u32 logical_index) {
   return 0;
 }
 
+// copies n elements from logical_index on into dst
+static void gap_copy(const GapBuffer* gap, u32 logical_index, u32 n, u32* dst) {
+  u32 before = logical_index >= gap->c ? 0 : gap->c - logical_index < n ? gap->c - logical_index : n;
+  memcpy(dst, gap->start + logical_index, sizeof(u32) * before);
+  memcpy(dst + before, gap->start + GAP_GET_BUFFER_INDEX(gap, logical_index + before), sizeof(u32) * (n - before));
+}
+
 // modify ch at index
 static void gap_set(GapBuffer* gap, u32 logical_index, u32 ch) {
   if (logical_index < GAP_LEN(gap))
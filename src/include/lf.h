@@ -0,0 +1,53 @@
+#pragma once
+// locating '\n' in raw bytes and decoded text, several at a time where SSE2 is there.
+
+#include <string.h>
+#include "itypes.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// true if src has a '\n' that isn't part of "\r\n"
+static bool lf_bare_bytes(const byte* src, usize n) {
+  for (const byte* nl = memchr(src, '\n', n); nl != NULL; nl = memchr(nl + 1, '\n', src + n - nl - 1)) {
+    if (nl == src || nl[-1] != '\r') return true;
+  }
+  return false;
+}
+
+// number of '\n' in text
+static u32 lf_count(const u32* text, u32 n) {
+  u32 count = 0, i = 0;
+#ifdef __SSE2__
+  const __m128i lf = _mm_set1_epi32('\n');
+  for (; i + 8 <= n; i += 8) {
+    __m128i a = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(text + i)), lf);
+    __m128i b = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(text + i + 4)), lf);
+    count += __builtin_popcount(_mm_movemask_epi8(_mm_packs_epi32(a, b))) / 2;
+  }
+#endif
+  for (; i < n; i++) {
+    count += text[i] == '\n';
+  }
+  return count;
+}
+
+// writes base + i + 1, the start of the next line, for every text[i] that is '\n'.
+// returns the number written
+static u32 lf_index(const u32* text, u32 n, u32 base, u32* starts) {
+  u32 count = 0, i = 0;
+#ifdef __SSE2__
+  const __m128i lf = _mm_set1_epi32('\n');
+  for (; i + 4 <= n; i += 4) {
+    u32 hits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(text + i)), lf)));
+    while (hits) {
+      starts[count++] = base + i + __builtin_ctz(hits) + 1;
+      hits &= hits - 1;
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    if (text[i] == '\n') starts[count++] = base + i + 1;
+  }
+  return count;
+}
@@ -0,0 +1,184 @@
+#pragma once
+// allocations tagged with the subsystem they belong to, so that memory use can be broken
+// down while the editor runs. sizes are taken from the allocator itself, callers only
+// name the tag. small fixed size blocks are carved out of slabs instead.
+
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "itypes.h"
+
+#define MEM_SLAB_BLOCKS 64 // blocks carved out of a single slab
+#define MEM_LOG_ENV "LAED_MEM_LOG" // file the breakdown is appended to, if set
+
+enum mem_tag {
+  mem_text, // buffer text and save snapshots
+  mem_lines, // line index
+  mem_undo, // undo and redo frames
+  mem_brackets, // bracket index
+  mem_diff, // line hashes and markers of diff
+  mem_finder, // cached paths of the finder
+  mem_grep, // grep hits
+  mem_folds, // folded line ranges
+  mem_words, // word index of completion
+  mem_anchors, // positions following edits
+  mem_wrap, // rows of soft wrapped lines
+  mem_io, // buffers of files being read or written
+  mem_misc,
+  MEM_TAGS,
+};
+
+static const char* mem_tag_names[MEM_TAGS] = {
+  "text", "lines", "undo", "brackets", "diff", "finder", "grep", "folds", "words", "anchors", "wrap", "io", "misc",
+};
+
+static atomic_llong mem_used[MEM_TAGS]; // bytes held per tag
+
+static inline void _mem_count(enum mem_tag tag, i64 bytes) {
+  atomic_fetch_add_explicit(&mem_used[tag], bytes, memory_order_relaxed);
+}
+
+static inline void* mem_alloc(enum mem_tag tag, usize size) {
+  void* p = malloc(size);
+  if (p != NULL) _mem_count(tag, malloc_usable_size(p));
+  return p;
+}
+
+// like realloc, p is left untouched if it fails
+static inline void* mem_realloc(enum mem_tag tag, void* p, usize size) {
+  i64 old = p != NULL ? (i64)malloc_usable_size(p) : 0;
+  void* grown = realloc(p, size);
+  if (grown != NULL) _mem_count(tag, (i64)malloc_usable_size(grown) - old);
+  return grown;
+}
+
+static inline void mem_free(enum mem_tag tag, void* p) {
+  if (p == NULL) return;
+  _mem_count(tag, -(i64)malloc_usable_size(p));
+  free(p);
+}
+
+// fixed size blocks for small and short lived allocations. freed blocks go to a free
+// list for the next one, slabs are only given back all at once
+struct mem_blocks {
+  enum mem_tag tag;
+  u32 size; // bytes per block
+  void* free; // unused blocks, linked through their first bytes
+  void** slabs;
+  u32 nslabs, cap;
+  u32 used; // blocks handed out
+};
+
+static inline struct mem_blocks mem_blocks_init(enum mem_tag tag, u32 size) {
+  return (struct mem_blocks){ .tag = tag, .size = size < sizeof(void*) ? sizeof(void*) : size };
+}
+
+static void* mem_block_get(struct mem_blocks* mb) {
+  if (mb->free == NULL) {
+    if (mb->nslabs == mb->cap) {
+      u32 cap = mb->cap ? mb->cap * 2 : 8;
+      void** slabs = mem_realloc(mb->tag, mb->slabs, sizeof(void*) * cap);
+      if (slabs == NULL) {
+        perror("failed to grow slabs");
+        exit(-1);
+      }
+      mb->slabs = slabs;
+      mb->cap = cap;
+    }
+    char* slab = mem_alloc(mb->tag, (usize)mb->size * MEM_SLAB_BLOCKS);
+    if (slab == NULL) {
+      perror("failed to allocate slab");
+      exit(-1);
+    }
+    mb->slabs[mb->nslabs++] = slab;
+    for (u32 i = MEM_SLAB_BLOCKS; i-- > 0;) {
+      *(void**)(slab + (usize)i * mb->size) = mb->free;
+      mb->free = slab + (usize)i * mb->size;
+    }
+  }
+  void* block = mb->free;
+  mb->free = *(void**)block;
+  mb->used++;
+  return block;
+}
+
+static inline void mem_block_put(struct mem_blocks* mb, void* block) {
+  *(void**)block = mb->free;
+  mb->free = block;
+  mb->used--;
+}
+
+// frees every slab, blocks still handed out become invalid
+static void mem_blocks_free(struct mem_blocks* mb) {
+  for (u32 i = 0; i < mb->nslabs; i++) {
+    mem_free(mb->tag, mb->slabs[i]);
+  }
+  mem_free(mb->tag, mb->slabs);
+  *mb = mem_blocks_init(mb->tag, mb->size);
+}
+
+// resident set size of the process in bytes, 0 if unknown
+static i64 mem_rss(void) {
+  FILE* f = fopen("/proc/self/statm", "r");
+  long pages = 0, resident = 0;
+  if (f == NULL) return 0;
+  if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+  fclose(f);
+  return (i64)resident * sysconf(_SC_PAGESIZE);
+}
+
+// bytes in a short human readable form
+static void mem_units(i64 bytes, char* out, usize n) {
+  if (bytes < 1024) {
+    snprintf(out, n, "%lldB", (long long)bytes);
+  } else if (bytes < 1024 * 1024) {
+    snprintf(out, n, "%.1fK", bytes / 1024.0);
+  } else if (bytes < 1024LL * 1024 * 1024) {
+    snprintf(out, n, "%.1fM", bytes / (1024.0 * 1024));
+  } else {
+    snprintf(out, n, "%.2fG", bytes / (1024.0 * 1024 * 1024));
+  }
+}
+
+// one line summary of the tags in use, largest first
+static void mem_summary(char* out, usize n) {
+  bool shown[MEM_TAGS] = {0};
+  i64 total = 0;
+  for (u32 t = 0; t < MEM_TAGS; t++) {
+    total += atomic_load(&mem_used[t]);
+  }
+  char units[16];
+  mem_units(total, units, sizeof(units));
+  usize len = snprintf(out, n, "%s tracked", units);
+  mem_units(mem_rss(), units, sizeof(units));
+  len += snprintf(out + len, len < n ? n - len : 0, ", rss %s:", units);
+  for (u32 k = 0; k < MEM_TAGS && len < n; k++) {
+    i32 best = -1;
+    for (u32 t = 0; t < MEM_TAGS; t++) {
+      if (!shown[t] && atomic_load(&mem_used[t]) > 0 && (best == -1 || atomic_load(&mem_used[t]) > atomic_load(&mem_used[best]))) {
+        best = t;
+      }
+    }
+    if (best == -1) break;
+    shown[best] = true;
+    mem_units(atomic_load(&mem_used[best]), units, sizeof(units));
+    len += snprintf(out + len, n - len, " %s %s", mem_tag_names[best], units);
+  }
+}
+
+// appends bytes held by every tag to the file named by MEM_LOG_ENV, if it is set
+static void mem_log(const char* event) {
+  const char* path = getenv(MEM_LOG_ENV);
+  if (path == NULL || *path == '\0') return;
+  FILE* f = fopen(path, "a");
+  if (f == NULL) return;
+  fprintf(f, "%lld %s rss=%lld", (long long)time(NULL), event, (long long)mem_rss());
+  for (u32 t = 0; t < MEM_TAGS; t++) {
+    fprintf(f, " %s=%lld", mem_tag_names[t], (long long)atomic_load(&mem_used[t]));
+  }
+  fputc('\n', f);
+  fclose(f);
+}
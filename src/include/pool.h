@@ -0,0 +1,183 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "itypes.h"
+
+typedef void (*pool_fn)(void* arg);
+
+struct pool_task {
+  pool_fn fn;
+  void* arg;
+};
+
+// fixed set of worker threads running tasks from a ring queue.
+// urgent tasks are taken from the front of the queue, ahead of background work
+typedef struct {
+  pthread_t* threads;
+  u32 nthreads;
+  pthread_mutex_t lock;
+  pthread_cond_t wake; // signaled when a task is queued or the pool stops
+  pthread_cond_t parted; // signaled when a part of pool_for finished
+  pthread_cond_t finished; // signaled when any task finished
+  struct pool_task* queue; // ring of queued tasks
+  u32 head, len, capacity;
+  bool stop;
+} Pool;
+
+static void* _pool_worker(void* arg) {
+  Pool* pool = arg;
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (pool->len == 0 && !pool->stop) {
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    if (pool->len == 0) break; // stopping and nothing left
+    struct pool_task task = pool->queue[pool->head];
+    pool->head = (pool->head + 1) % pool->capacity;
+    pool->len--;
+    pthread_mutex_unlock(&pool->lock);
+    task.fn(task.arg);
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->finished);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+// starts a pool with a worker per online cpu
+static Pool* pool_init(void) {
+  Pool* pool = calloc(1, sizeof(Pool));
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (pool != NULL) {
+    pool->nthreads = cpus > 0 ? cpus : 1;
+    pool->capacity = 64;
+    pool->queue = malloc(sizeof(struct pool_task) * pool->capacity);
+    pool->threads = malloc(sizeof(pthread_t) * pool->nthreads);
+  }
+  if (pool == NULL || pool->queue == NULL || pool->threads == NULL) {
+    perror("failed to initialize thread pool");
+    exit(-1);
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->parted, NULL);
+  pthread_cond_init(&pool->finished, NULL);
+  for (u32 i = 0; i < pool->nthreads; i++) {
+    if (pthread_create(&pool->threads[i], NULL, _pool_worker, pool) != 0) {
+      perror("failed to start pool worker");
+      exit(-1);
+    }
+  }
+  return pool;
+}
+
+// queues fn(arg). urgent tasks run before every task queued normally
+static void pool_submit(Pool* pool, pool_fn fn, void* arg, bool urgent) {
+  pthread_mutex_lock(&pool->lock);
+  if (pool->len == pool->capacity) { // unroll the ring into a larger one
+    struct pool_task* queue = malloc(sizeof(struct pool_task) * pool->capacity * 2);
+    if (queue == NULL) {
+      perror("failed to grow pool queue");
+      exit(-1);
+    }
+    for (u32 i = 0; i < pool->len; i++) {
+      queue[i] = pool->queue[(pool->head + i) % pool->capacity];
+    }
+    free(pool->queue);
+    pool->queue = queue;
+    pool->head = 0;
+    pool->capacity *= 2;
+  }
+  if (urgent) {
+    pool->head = (pool->head + pool->capacity - 1) % pool->capacity;
+    pool->queue[pool->head] = (struct pool_task){ fn, arg };
+  } else {
+    pool->queue[(pool->head + pool->len) % pool->capacity] = (struct pool_task){ fn, arg };
+  }
+  pool->len++;
+  pthread_cond_signal(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+typedef void (*pool_range_fn)(void* arg, u32 part, usize begin, usize end);
+
+struct _pool_part {
+  Pool* pool;
+  pool_range_fn fn;
+  void* arg;
+  u32 part;
+  usize begin, end;
+  u32* left; // parts still running, guarded by the pool lock
+};
+
+static void _pool_run_part(void* arg) {
+  struct _pool_part* p = arg;
+  p->fn(p->arg, p->part, p->begin, p->end);
+  pthread_mutex_lock(&p->pool->lock);
+  if (--*p->left == 0) {
+    pthread_cond_broadcast(&p->pool->parted);
+  }
+  pthread_mutex_unlock(&p->pool->lock);
+}
+
+// number of parts pool_for splits n items into, at least min_part items each
+static inline u32 pool_parts(Pool* pool, usize n, usize min_part) {
+  usize parts = n / (min_part ? min_part : 1);
+  if (parts > pool->nthreads) parts = pool->nthreads;
+  return parts > 0 ? parts : 1;
+}
+
+// runs fn over [0, n) split into pool_parts() contiguous parts, ahead of queued
+// background work. blocks until every part has finished
+static void pool_for(Pool* pool, usize n, usize min_part, pool_range_fn fn, void* arg) {
+  u32 parts = pool_parts(pool, n, min_part);
+  if (parts == 1) {
+    fn(arg, 0, 0, n);
+    return;
+  }
+  struct _pool_part part[parts];
+  u32 left = parts;
+  for (u32 i = 0; i < parts; i++) {
+    part[i] = (struct _pool_part){ pool, fn, arg, i, n * i / parts, n * (i + 1) / parts, &left };
+    pool_submit(pool, _pool_run_part, &part[i], true);
+  }
+  pthread_mutex_lock(&pool->lock);
+  while (left > 0) {
+    pthread_cond_wait(&pool->parted, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// blocks until the tasks counted by left are all done. they have to take themselves
+// off left as the last thing they do with their arguments
+static void pool_wait(Pool* pool, atomic_uint* left) {
+  pthread_mutex_lock(&pool->lock);
+  while (atomic_load(left) > 0) {
+    pthread_cond_wait(&pool->finished, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// lets the workers drain the queue and frees the pool. long running tasks are expected
+// to watch a cancellation flag of their own
+static void pool_free(Pool* pool) {
+  if (pool == NULL) return;
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+  for (u32 i = 0; i < pool->nthreads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->wake);
+  pthread_cond_destroy(&pool->parted);
+  pthread_cond_destroy(&pool->finished);
+  free(pool->queue);
+  free(pool->threads);
+  free(pool);
+}
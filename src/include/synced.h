@@ -0,0 +1,71 @@
+#pragma once
+// how much of buffer is still what its file holds, so that a save only has to encode
+// and write the rest. points pair a prefix of buffer with the bytes of the file it was
+// decoded from or encoded into; loading and saving leave one every so often. an edit
+// drops the points after it, and a save starts over from the last point left before
+// the first character changed since.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include "itypes.h"
+#include "mem.h"
+#include "utils.h"
+
+#define SYNCED_NONE UINT32_MAX // dirty when buffer is what the file holds
+
+struct save_point {
+  u32 chars; // characters of buffer before the point
+  off_t bytes; // bytes of the file those characters are in
+};
+
+struct synced {
+  struct save_point* v; // sorted, all at or before dirty
+  u32 n, cap;
+  u32 dirty; // first character changed since buffer was what the file holds
+};
+
+static inline void synced_init(struct synced* s) {
+  *s = (struct synced){ .dirty = SYNCED_NONE };
+}
+
+static void synced_free(struct synced* s) {
+  mem_free(mem_misc, s->v);
+  synced_init(s);
+}
+
+// follows an edit at pos, the file no longer holds what comes after it
+static inline void synced_edit(struct synced* s, u32 pos) {
+  s->dirty = MIN(s->dirty, pos);
+  while (s->n > 0 && s->v[s->n - 1].chars > pos) {
+    s->n--;
+  }
+}
+
+// adds a point past the last one. ignored if buffer has changed before chars
+static void synced_add(struct synced* s, u32 chars, off_t bytes) {
+  if (chars > s->dirty || (s->n > 0 && s->v[s->n - 1].chars >= chars)) return;
+  if (s->n == s->cap) {
+    u32 cap = s->cap == 0 ? 64 : s->cap * 2;
+    struct save_point* grown = mem_realloc(mem_misc, s->v, sizeof(struct save_point) * cap);
+    if (grown == NULL) return; // fewer points only make saves write more
+    s->v = grown;
+    s->cap = cap;
+  }
+  s->v[s->n++] = (struct save_point){ chars, bytes };
+}
+
+// last point at or before the first changed character, where a save of len characters
+// has to start writing
+static struct save_point synced_resume(const struct synced* s, u32 len) {
+  u32 upto = MIN(s->dirty, len), lo = 0, hi = s->n;
+  while (lo < hi) {
+    u32 mid = lo + (hi - lo) / 2;
+    if (s->v[mid].chars <= upto) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo > 0 ? s->v[lo - 1] : (struct save_point){0};
+}
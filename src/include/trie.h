@@ -0,0 +1,169 @@
+#pragma once
+// prefix tree of words with a count per word. every node also keeps the highest count
+// found below it, so the most frequent words under a prefix are found best first,
+// visiting little more than the nodes on their paths. nodes live in a single array and
+// are never given back, a word whose count drops to 0 just stops being found.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "itypes.h"
+#include "mem.h"
+#include "utils.h"
+
+#define TRIE_NONE 0 // node 0 is the root, never a child
+#define TRIE_DEPTH 64 // longest word kept
+#define TRIE_HEAP 1024 // candidates looked at per query
+
+struct trie_node {
+  u32 ch;
+  u32 parent, child, next; // first child and next sibling
+  u32 count; // of the word ending here
+  u32 best; // highest count of this node and those below it
+};
+
+struct trie {
+  struct trie_node* v;
+  u32 n, cap;
+};
+
+static void trie_init(struct trie* t) {
+  t->cap = 256;
+  t->v = mem_alloc(mem_words, sizeof(struct trie_node) * t->cap);
+  if (t->v == NULL) {
+    perror("trie_init");
+    exit(-1);
+  }
+  t->v[0] = (struct trie_node){0};
+  t->n = 1;
+}
+
+static void trie_free(struct trie* t) {
+  mem_free(mem_words, t->v);
+  *t = (struct trie){0};
+}
+
+// child of node for ch, TRIE_NONE if there is none
+static u32 _trie_child(const struct trie* t, u32 node, u32 ch) {
+  for (u32 c = t->v[node].child; c != TRIE_NONE; c = t->v[c].next) {
+    if (t->v[c].ch == ch) return c;
+  }
+  return TRIE_NONE;
+}
+
+// child of node for ch, created if missing. a found child is moved to the front of its
+// siblings, so the words counted most often are walked the fastest
+static u32 _trie_make(struct trie* t, u32 node, u32 ch) {
+  for (u32 c = t->v[node].child, prev = TRIE_NONE; c != TRIE_NONE; prev = c, c = t->v[c].next) {
+    if (t->v[c].ch != ch) continue;
+    if (prev != TRIE_NONE) {
+      t->v[prev].next = t->v[c].next;
+      t->v[c].next = t->v[node].child;
+      t->v[node].child = c;
+    }
+    return c;
+  }
+  if (t->n == t->cap) {
+    struct trie_node* grown = mem_realloc(mem_words, t->v, sizeof(struct trie_node) * t->cap * 2);
+    if (grown == NULL) {
+      perror("trie grow");
+      exit(-1);
+    }
+    t->v = grown;
+    t->cap *= 2;
+  }
+  u32 c = t->n++;
+  t->v[c] = (struct trie_node){ .ch = ch, .parent = node, .next = t->v[node].child };
+  t->v[node].child = c;
+  return c;
+}
+
+// changes the count of word by delta
+static void trie_add(struct trie* t, const u32* word, u32 len, i32 delta) {
+  if (len == 0 || len > TRIE_DEPTH) return;
+  u32 node = 0;
+  for (u32 i = 0; i < len; i++) {
+    node = delta > 0 ? _trie_make(t, node, word[i]) : _trie_child(t, node, word[i]);
+    if (node == TRIE_NONE) return; // removing a word that was never added
+  }
+  struct trie_node* nd = &t->v[node];
+  nd->count = delta < 0 && (u32)-delta > nd->count ? 0 : nd->count + delta;
+  if (delta > 0) { // counts only grew
+    for (u32 at = node; at != 0 && t->v[at].best < nd->count; at = t->v[at].parent) {
+      t->v[at].best = nd->count;
+    }
+    return;
+  }
+  for (u32 at = node; at != 0; at = t->v[at].parent) { // recomputed from the children
+    u32 best = t->v[at].count;
+    for (u32 c = t->v[at].child; c != TRIE_NONE; c = t->v[c].next) {
+      best = MAX(best, t->v[c].best);
+    }
+    if (best == t->v[at].best) break;
+    t->v[at].best = best;
+  }
+}
+
+// writes the word ending at node into out, returns its length
+static u32 trie_word(const struct trie* t, u32 node, u32* out) {
+  u32 len = 0;
+  for (u32 at = node; at != 0; at = t->v[at].parent) len++;
+  for (u32 at = node, i = len; at != 0; at = t->v[at].parent) out[--i] = t->v[at].ch;
+  return len;
+}
+
+struct _trie_item {
+  u32 key, node;
+  bool word; // stands for the word ending at node, else for the nodes below it
+};
+
+static void _trie_push(struct _trie_item* heap, u32* n, struct _trie_item item) {
+  if (*n == TRIE_HEAP) return; // the search gives up on candidates past this many
+  u32 i = (*n)++;
+  for (; i > 0 && heap[(i - 1) / 2].key < item.key; i = (i - 1) / 2) {
+    heap[i] = heap[(i - 1) / 2];
+  }
+  heap[i] = item;
+}
+
+static struct _trie_item _trie_pop(struct _trie_item* heap, u32* n) {
+  struct _trie_item top = heap[0], last = heap[--(*n)];
+  u32 i = 0;
+  while (2 * i + 1 < *n) {
+    u32 c = 2 * i + 1;
+    if (c + 1 < *n && heap[c + 1].key > heap[c].key) c++;
+    if (heap[c].key <= last.key) break;
+    heap[i] = heap[c];
+    i = c;
+  }
+  heap[i] = last;
+  return top;
+}
+
+// finds up to max words longer than prefix starting with it, most frequent first.
+// returns the number of their nodes written to out
+static u32 trie_top(const struct trie* t, const u32* prefix, u32 plen, u32* out, u32 max) {
+  u32 node = 0;
+  for (u32 i = 0; i < plen; i++) {
+    node = _trie_child(t, node, prefix[i]);
+    if (node == TRIE_NONE) return 0;
+  }
+  if (max == 0) return 0;
+  struct _trie_item heap[TRIE_HEAP];
+  u32 n = 0, found = 0;
+  for (u32 c = t->v[node].child; c != TRIE_NONE; c = t->v[c].next) {
+    if (t->v[c].best > 0) _trie_push(heap, &n, (struct _trie_item){ t->v[c].best, c, false });
+  }
+  while (n > 0 && found < max) {
+    struct _trie_item it = _trie_pop(heap, &n);
+    if (it.word) {
+      out[found++] = it.node;
+      continue;
+    }
+    const struct trie_node* nd = &t->v[it.node];
+    if (nd->count > 0) _trie_push(heap, &n, (struct _trie_item){ nd->count, it.node, true });
+    for (u32 c = nd->child; c != TRIE_NONE; c = t->v[c].next) {
+      if (t->v[c].best > 0) _trie_push(heap, &n, (struct _trie_item){ t->v[c].best, c, false });
+    }
+  }
+  return found;
+}
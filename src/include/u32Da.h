@@ -6,6 +6,7 @@
 #include <error.h>
 #include <errno.h>
 #include "itypes.h"
+#include "mem.h"
 
 #define GROWTH_FAC 1.5
 #define __SET_REALLOC_SIZE(capacity) ((capacity) = (capacity) * GROWTH_FAC)
@@ -15,11 +16,23 @@ typedef struct u32Da {
   u32* _elements;
   usize _capacity;
   usize len;
+  enum mem_tag _tag;
+  struct mem_blocks* _blocks; // _elements is a block of these until it outgrows it
 } u32Da;
 
 static void __u32Da_grow(u32Da* da) {
   __SET_REALLOC_SIZE(da->_capacity);
-  u32* new_elements = realloc(da->_elements, sizeof(u32) * da->_capacity);
+  u32* new_elements;
+  if (da->_blocks != NULL) { // moves out of the block
+    new_elements = mem_alloc(da->_tag, sizeof(u32) * da->_capacity);
+    if (new_elements != NULL) {
+      memcpy(new_elements, da->_elements, sizeof(u32) * da->len);
+      mem_block_put(da->_blocks, da->_elements);
+      da->_blocks = NULL;
+    }
+  } else {
+    new_elements = mem_realloc(da->_tag, da->_elements, sizeof(u32) * da->_capacity);
+  }
   if (new_elements == NULL) {
     error(EXIT_FAILURE, errno,  "failed to grow _elements");
   }
@@ -78,16 +91,21 @@ static void u32Da_set(u32Da* da, u32 val, isize pos) {
 
 /// Frees internal buffer and zeros out the structure.
 static void u32Da_free(u32Da* arr) { 
-  free(arr->_elements);
+  if (arr->_blocks != NULL) {
+    mem_block_put(arr->_blocks, arr->_elements);
+  } else {
+    mem_free(arr->_tag, arr->_elements);
+  }
   *arr = (u32Da){0};
 }
 
 /// Initializes a new dynamic array with given capacity and error handler.
-static u32Da u32Da_init(usize capacity) {
+static u32Da u32Da_init(usize capacity, enum mem_tag tag) {
   u32Da da = {
-    ._elements = malloc(sizeof(u32) * capacity),
+    ._elements = mem_alloc(tag, sizeof(u32) * capacity),
     ._capacity = capacity,
     .len = 0,
+    ._tag = tag,
   };
   if (da._elements == NULL) {
     fprintf(stderr, "failed to initialize dynamic arr\n");
@@ -96,5 +114,16 @@ static u32Da u32Da_init(usize capacity) {
   return da;
 }
 
+/// Initializes a new dynamic array in a block of blocks, moving to the heap once it outgrows it.
+static u32Da u32Da_init_block(struct mem_blocks* blocks) {
+  return (u32Da){
+    ._elements = mem_block_get(blocks),
+    ._capacity = blocks->size / sizeof(u32),
+    .len = 0,
+    ._tag = blocks->tag,
+    ._blocks = blocks,
+  };
+}
+
 /// Resets length to 0 without deallocating memory.
 static inline void u32Da_reset(u32Da* da) { da->len = 0; }
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "itypes.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// bytes that are not part of a valid utf-8 sequence are kept as code points of the
+// lone surrogate range U+DC80..U+DCFF, so that decoding and encoding back is lossless.
+#define UTF8_ESCAPE_BASE 0xDC00
+#define UTF8_ESCAPE(b) (UTF8_ESCAPE_BASE + (b))
+#define UTF8_REPLACEMENT 0xFFFD // shown in place of escaped bytes
+
+static inline bool utf8_is_escape(u32 cp) { return cp >= UTF8_ESCAPE(0x80) && cp <= UTF8_ESCAPE(0xFF); }
+
+// line ending convention of a text
+enum eol {
+  eol_auto = 0, // to be detected from the first line ending while decoding
+  eol_lf,
+  eol_crlf,
+};
+
+// number of bytes required to encode cp as utf-8
+static inline u8 utf8_len(u32 cp) {
+  if (cp < 0x80) return 1;
+  if (cp < 0x800) return 2;
+  if (cp < 0x10000) return utf8_is_escape(cp) ? 1 : 3;
+  return 4;
+}
+
+// encodes cp into out (needs room for 4 bytes). returns number of bytes written
+static inline u8 utf8_encode(u32 cp, byte* out) {
+  if (cp < 0x80) {
+    out[0] = cp;
+    return 1;
+  } else if (cp < 0x800) {
+    out[0] = 0xC0 | (cp >> 6);
+    out[1] = 0x80 | (cp & 0x3F);
+    return 2;
+  } else if (cp < 0x10000) {
+    if (utf8_is_escape(cp)) {
+      out[0] = cp - UTF8_ESCAPE_BASE;
+      return 1;
+    }
+    out[0] = 0xE0 | (cp >> 12);
+    out[1] = 0x80 | ((cp >> 6) & 0x3F);
+    out[2] = 0x80 | (cp & 0x3F);
+    return 3;
+  }
+  out[0] = 0xF0 | (cp >> 18);
+  out[1] = 0x80 | ((cp >> 12) & 0x3F);
+  out[2] = 0x80 | ((cp >> 6) & 0x3F);
+  out[3] = 0x80 | (cp & 0x3F);
+  return 4;
+}
+
+// encodes n code points from src into dst. dst should have room for 4 * n bytes.
+// newlines are written as eol. returns the number of bytes written
+static usize utf8_encode_text(const u32* src, usize n, byte* dst, enum eol eol) {
+  byte* out = dst;
+  usize i = 0;
+  while (i < n) {
+#ifdef __SSE2__
+    if (i + 16 <= n) { // all ascii fast path, 16 code points at a time
+      const __m128i* at = (const __m128i*)(src + i);
+      __m128i a = _mm_loadu_si128(at), b = _mm_loadu_si128(at + 1);
+      __m128i c = _mm_loadu_si128(at + 2), d = _mm_loadu_si128(at + 3);
+      __m128i high = _mm_and_si128(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), _mm_set1_epi32(~0x7F));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(high, _mm_setzero_si128())) == 0xFFFF) {
+        __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        if (eol != eol_crlf || _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))) == 0) {
+          _mm_storeu_si128((__m128i*)out, bytes);
+          out += 16;
+          i += 16;
+          continue;
+        }
+      }
+    }
+#endif
+    if (src[i] == '\n' && eol == eol_crlf) {
+      *out++ = '\r';
+    }
+    out += utf8_encode(src[i], out);
+    i++;
+  }
+  return out - dst;
+}
+
+// decodes a single code point from src (n > 0 bytes available) into cp.
+// returns the number of bytes consumed. a malformed sequence yields the escape of
+// its first byte and consumes only that byte.
+static inline u8 utf8_decode(const byte* src, usize n, u32* cp) {
+  byte b = src[0];
+  if (b < 0x80) {
+    *cp = b;
+    return 1;
+  }
+  u8 len;
+  u32 min;
+  if ((b & 0xE0) == 0xC0) { len = 2; min = 0x80; *cp = b & 0x1F; }
+  else if ((b & 0xF0) == 0xE0) { len = 3; min = 0x800; *cp = b & 0x0F; }
+  else if ((b & 0xF8) == 0xF0) { len = 4; min = 0x10000; *cp = b & 0x07; }
+  else goto malformed;
+  if (n < len) goto malformed;
+  for (u8 i = 1; i < len; i++) {
+    if ((src[i] & 0xC0) != 0x80) goto malformed;
+    *cp = (*cp << 6) | (src[i] & 0x3F);
+  }
+  if (*cp < min || *cp > 0x10FFFF || (*cp >= 0xD800 && *cp <= 0xDFFF)) goto malformed;
+  return len;
+  malformed:
+  *cp = UTF8_ESCAPE(b);
+  return 1;
+}
+
+// decodes n bytes of src into dst (needs room for n code points) and returns the
+// number of code points written. with eol_crlf, "\r\n" becomes a single '\n'.
+// *eol is detected from the first line ending when eol_auto is given. if a detected
+// crlf text turns out to also contain bare "\n", it is decoded again as eol_lf so
+// that encoding it back reproduces the input exactly.
+static usize utf8_decode_text(const byte* src, usize n, u32* dst, enum eol* eol) {
+  enum eol mode = *eol;
+  bool detected = false;
+  restart:;
+  u32* out = dst;
+  usize i = 0;
+  while (i < n) {
+#ifdef __SSE2__
+    if (i + 16 <= n) { // all ascii fast path, 16 bytes at a time
+      __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+      u32 lf = mode == eol_lf ? 0 : _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+      if (_mm_movemask_epi8(v) == 0 && lf == 0) {
+        __m128i z = _mm_setzero_si128();
+        __m128i lo = _mm_unpacklo_epi8(v, z), hi = _mm_unpackhi_epi8(v, z);
+        _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi16(lo, z));
+        _mm_storeu_si128((__m128i*)out + 1, _mm_unpackhi_epi16(lo, z));
+        _mm_storeu_si128((__m128i*)out + 2, _mm_unpacklo_epi16(hi, z));
+        _mm_storeu_si128((__m128i*)out + 3, _mm_unpackhi_epi16(hi, z));
+        out += 16;
+        i += 16;
+        continue;
+      }
+    }
+#endif
+    if (src[i] == '\n' && mode != eol_lf) {
+      bool after_cr = i > 0 && src[i - 1] == '\r';
+      if (mode == eol_auto) {
+        mode = after_cr ? eol_crlf : eol_lf;
+        detected = true;
+      } else if (!after_cr && detected) { // mixed line endings
+        mode = eol_lf;
+        detected = false;
+        goto restart;
+      }
+      if (mode == eol_crlf && after_cr) {
+        out--; // '\r' was written already
+      }
+    }
+    i += utf8_decode(src + i, n - i, out++);
+  }
+  *eol = mode == eol_auto ? eol_lf : mode;
+  return out - dst;
+}
+
+// length of the prefix of src (n bytes) that doesn't end inside an incomplete sequence.
+// used to decode a byte stream that may be cut at an arbitrary position
+static usize utf8_complete_len(const byte* src, usize n) {
+  for (usize back = 1; back <= 3 && back <= n; back++) {
+    byte b = src[n - back];
+    if ((b & 0xC0) == 0x80) continue; // continuation byte
+    u8 len = (b & 0xE0) == 0xC0 ? 2 : (b & 0xF0) == 0xE0 ? 3 : (b & 0xF8) == 0xF0 ? 4 : 1;
+    return len > back ? n - back : n;
+  }
+  return n;
+}
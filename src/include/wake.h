@@ -0,0 +1,34 @@
+#pragma once
+// wakes the thread waiting for events once a worker has published something for it.
+// any number of signals before the waiting thread gets to run wake it up once.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "itypes.h"
+
+static int wake_fd = -1; // eventfd shared by every worker, polled by the main loop
+
+static void wake_init(void) {
+  if (wake_fd != -1) return;
+  wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd == -1) {
+    perror("wake_init");
+    exit(-1);
+  }
+}
+
+static inline void wake_signal(void) {
+  u64 one = 1;
+  if (wake_fd != -1 && write(wake_fd, &one, sizeof(one)) == -1) {
+    // the counter is full, so there is a wake pending anyway
+  }
+}
+
+static inline void wake_drain(void) {
+  u64 count;
+  if (read(wake_fd, &count, sizeof(count)) == -1) {
+    // nothing was signaled
+  }
+}
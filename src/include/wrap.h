@@ -0,0 +1,287 @@
+#pragma once
+// layout of soft wrapped lines: how many rows on screen each line takes. lines are kept
+// in a treap in the order they come in, every node summing up the lines and rows below
+// it. so the row of a line and the line at a row are both found in O(log n), and lines
+// added or removed by an edit are split off and merged back in O(log n) too. lines
+// hidden by a fold take no rows. an edit only marks the lines it touched to be wrapped
+// again.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "itypes.h"
+#include "mem.h"
+#include "utils.h"
+#include "fold.h"
+
+#define WRAP_NONE 0 // node 0 is never used, it stands for the empty tree
+
+struct wrap_node {
+  u32 rows; // rows the line takes
+  u32 sum; // rows of the lines shown in the subtree
+  u32 size; // lines in the subtree
+  u32 left, right; // left is the next free node once dropped
+  bool hidden; // by a fold
+};
+
+struct wrap {
+  bool on;
+  u16 width; // columns lines are wrapped at, 0 until they are wrapped at all
+  struct wrap_node* v;
+  u32 n, cap; // nodes used, including dropped ones
+  u32 root, free;
+  u32 stale_from, stale_to; // lines to be wrapped again
+  u32 folds; // rev of folds lines were hidden by
+};
+
+static void wrap_free(struct wrap* w) {
+  mem_free(mem_wrap, w->v);
+  *w = (struct wrap){0};
+}
+
+// priority of node in the treap, a hash of its id so that it needs no room
+static inline u32 _wrap_prio(u32 node) {
+  node *= 0x9E3779B1;
+  node ^= node >> 15;
+  node *= 0x85EBCA77;
+  return node ^ (node >> 13);
+}
+
+static inline void _wrap_pull(struct wrap* w, u32 node) {
+  struct wrap_node* nd = &w->v[node];
+  nd->size = w->v[nd->left].size + 1 + w->v[nd->right].size;
+  nd->sum = w->v[nd->left].sum + (nd->hidden ? 0 : nd->rows) + w->v[nd->right].sum;
+}
+
+// makes room for n nodes
+static void _wrap_reserve(struct wrap* w, u32 n) {
+  if (n <= w->cap) return;
+  u32 cap = MAX(w->cap * 2, MAX(n, 64));
+  struct wrap_node* v = mem_realloc(mem_wrap, w->v, sizeof(struct wrap_node) * cap);
+  if (v == NULL) {
+    perror("_wrap_reserve");
+    exit(-1);
+  }
+  w->v = v;
+  w->cap = cap;
+}
+
+// a line of no rows yet
+static u32 _wrap_new(struct wrap* w) {
+  u32 node = w->free;
+  if (node != WRAP_NONE) {
+    w->free = w->v[node].left;
+  } else {
+    _wrap_reserve(w, w->n + 2); // the empty tree comes first
+    if (w->n == 0) { // the empty tree
+      w->v[0] = (struct wrap_node){0};
+      w->n = 1;
+    }
+    node = w->n++;
+  }
+  w->v[node] = (struct wrap_node){ .size = 1 };
+  return node;
+}
+
+// count new lines as a treap of their own, built in order in O(count) keeping the nodes
+// on its right spine in a stack. they are of no rows yet, unless rows is given: then
+// they are the lines from the first on, taking the rows it returns and hidden by f
+static u32 _wrap_make(struct wrap* w, u32 count, const struct folds* f, u32 (*rows)(void* arg, u32 line), void* arg) {
+  u32 small[64];
+  u32* stack = count <= 64 ? small : mem_alloc(mem_wrap, sizeof(u32) * count);
+  if (stack == NULL) {
+    perror("_wrap_make");
+    exit(-1);
+  }
+  u32 top = 0, k = 0; // k is the next fold
+  for (u32 i = 0; i < count; i++) {
+    u32 node = _wrap_new(w), below = WRAP_NONE;
+    if (rows != NULL) {
+      while (k < f->n && f->v[k].last < i) k++;
+      w->v[node].hidden = k < f->n && f->v[k].first < i;
+      w->v[node].rows = rows(arg, i);
+    }
+    while (top > 0 && _wrap_prio(stack[top - 1]) < _wrap_prio(node)) {
+      below = stack[--top];
+      _wrap_pull(w, below);
+    }
+    w->v[node].left = below;
+    if (top > 0) w->v[stack[top - 1]].right = node;
+    stack[top++] = node;
+  }
+  for (u32 i = top; i-- > 0;) {
+    _wrap_pull(w, stack[i]);
+  }
+  u32 root = top > 0 ? stack[0] : WRAP_NONE;
+  if (stack != small) mem_free(mem_wrap, stack);
+  return root;
+}
+
+// gives back the nodes of a subtree
+static void _wrap_drop(struct wrap* w, u32 node) {
+  if (node == WRAP_NONE) return;
+  _wrap_drop(w, w->v[node].left);
+  _wrap_drop(w, w->v[node].right);
+  w->v[node].left = w->free;
+  w->free = node;
+}
+
+// splits node into its first count lines and the rest
+static void _wrap_split(struct wrap* w, u32 node, u32 count, u32* l, u32* r) {
+  if (node == WRAP_NONE) {
+    *l = *r = WRAP_NONE;
+    return;
+  }
+  u32 left = w->v[w->v[node].left].size;
+  if (count <= left) {
+    _wrap_split(w, w->v[node].left, count, l, &w->v[node].left);
+    *r = node;
+  } else {
+    _wrap_split(w, w->v[node].right, count - left - 1, &w->v[node].right, r);
+    *l = node;
+  }
+  _wrap_pull(w, node);
+}
+
+// joins two treaps, the lines of l coming before those of r
+static u32 _wrap_merge(struct wrap* w, u32 l, u32 r) {
+  if (l == WRAP_NONE) return r;
+  if (r == WRAP_NONE) return l;
+  if (_wrap_prio(l) > _wrap_prio(r)) {
+    u32 right = _wrap_merge(w, w->v[l].right, r);
+    w->v[l].right = right;
+    _wrap_pull(w, l);
+    return l;
+  }
+  u32 left = _wrap_merge(w, l, w->v[r].left);
+  w->v[r].left = left;
+  _wrap_pull(w, r);
+  return r;
+}
+
+static inline u32 wrap_lines(const struct wrap* w) { return w->root != WRAP_NONE ? w->v[w->root].size : 0; }
+
+static inline u32 wrap_total(const struct wrap* w) { return w->root != WRAP_NONE ? w->v[w->root].sum : 0; }
+
+// drops every line for n new ones, taking the rows that rows returns for them and
+// hidden by f
+static void wrap_reset(struct wrap* w, u32 n, const struct folds* f, u32 (*rows)(void* arg, u32 line), void* arg) {
+  w->n = 0;
+  w->root = w->free = WRAP_NONE;
+  _wrap_reserve(w, n + 1);
+  w->root = _wrap_make(w, n, f, rows, arg);
+  w->folds = f->rev;
+}
+
+// follows an edit on line that removed the removed lines after it and added added ones.
+// line and the lines added are wrapped again
+static void wrap_edit(struct wrap* w, u32 line, u32 removed, u32 added) {
+  if (!w->on || w->width == 0) return; // everything is wrapped anyway
+  if (added != removed) {
+    u32 head, rest, gone, tail;
+    _wrap_split(w, w->root, line + 1, &head, &rest);
+    _wrap_split(w, rest, removed, &gone, &tail);
+    _wrap_drop(w, gone);
+    w->root = _wrap_merge(w, _wrap_merge(w, head, _wrap_make(w, added, NULL, NULL, NULL)), tail);
+  }
+  u32 to = line + added + 1;
+  if (w->stale_from < w->stale_to) {
+    u32 old_to = w->stale_to > line + removed + 1 ? w->stale_to + added - removed : MIN(w->stale_to, line + 1);
+    w->stale_from = MIN(w->stale_from, line);
+    w->stale_to = MAX(to, old_to);
+  } else {
+    w->stale_from = line;
+    w->stale_to = to;
+  }
+}
+
+static void _wrap_set(struct wrap* w, u32 node, u32 line, u32 rows, bool hidden) {
+  u32 left = w->v[w->v[node].left].size;
+  if (line < left) {
+    _wrap_set(w, w->v[node].left, line, rows, hidden);
+  } else if (line > left) {
+    _wrap_set(w, w->v[node].right, line - left - 1, rows, hidden);
+  } else {
+    w->v[node].rows = rows;
+    w->v[node].hidden = hidden;
+  }
+  _wrap_pull(w, node);
+}
+
+// sets the rows line takes, and whether a fold hides it
+static inline void wrap_set(struct wrap* w, u32 line, u32 rows, bool hidden) {
+  if (line < wrap_lines(w)) _wrap_set(w, w->root, line, rows, hidden);
+}
+
+static void _wrap_hide(struct wrap* w, u32 node, u32* line, const struct folds* f, u32* k) {
+  if (node == WRAP_NONE) return;
+  _wrap_hide(w, w->v[node].left, line, f, k);
+  while (*k < f->n && f->v[*k].last < *line) (*k)++;
+  w->v[node].hidden = *k < f->n && f->v[*k].first < *line;
+  (*line)++;
+  _wrap_hide(w, w->v[node].right, line, f, k);
+  _wrap_pull(w, node);
+}
+
+// hides the lines folded by f, and shows the others, in O(n)
+static void wrap_hide(struct wrap* w, const struct folds* f) {
+  u32 line = 0, k = 0; // k is the next fold
+  _wrap_hide(w, w->root, &line, f, &k);
+  w->folds = f->rev;
+}
+
+// rows line takes, hidden or not
+static u32 wrap_rows(const struct wrap* w, u32 line) {
+  for (u32 node = w->root; node != WRAP_NONE;) {
+    u32 left = w->v[w->v[node].left].size;
+    if (line == left) return w->v[node].rows;
+    node = line < left ? w->v[node].left : w->v[node].right;
+    if (line > left) line -= left + 1;
+  }
+  return 0;
+}
+
+// rows taken by the lines shown before line
+static u32 wrap_row(const struct wrap* w, u32 line) {
+  u32 row = 0;
+  for (u32 node = w->root; node != WRAP_NONE;) {
+    const struct wrap_node* nd = &w->v[node];
+    u32 left = w->v[nd->left].size;
+    if (line < left) {
+      node = nd->left;
+      continue;
+    }
+    row += w->v[nd->left].sum;
+    if (line == left) break;
+    row += nd->hidden ? 0 : nd->rows;
+    line -= left + 1;
+    node = nd->right;
+  }
+  return row;
+}
+
+// line shown at row, *sub is set to the row of it. past the end it is the last row
+static u32 wrap_line(const struct wrap* w, u32 row, u32* sub) {
+  u32 total = wrap_total(w);
+  if (total == 0) {
+    *sub = 0;
+    return 0;
+  }
+  row = MIN(row, total - 1);
+  u32 line = 0, node = w->root;
+  for (;;) { // row is always within the subtree of node
+    const struct wrap_node* nd = &w->v[node];
+    u32 left = w->v[nd->left].sum, own = nd->hidden ? 0 : nd->rows;
+    if (row < left) {
+      node = nd->left;
+      continue;
+    }
+    line += w->v[nd->left].size;
+    if (row - left < own) {
+      *sub = row - left;
+      return line;
+    }
+    row -= left + own;
+    line++;
+    node = nd->right;
+  }
+}
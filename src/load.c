@@ -0,0 +1,345 @@
+#pragma once
+// progressive loading of a file into buffer.
+// the first LOAD_FIRST bytes are decoded right away so the first screen can be drawn,
+// the rest is loaded by a worker thread. it reads batches that are cut after newlines
+// into one part per pool worker. parts are decoded and have their line starts located in
+// parallel, and the newlines of every batch are added to the count as it is decoded.
+// decoded chunks are queued for the main thread, which appends them on every tick and
+// only has to rebase their line starts onto the end of buffer. anything that needs lines
+// which are not in yet waits only until they are.
+
+#include <fcntl.h>
+
+#define LOAD_FIRST KB(64) // bytes decoded before the first draw
+#define LOAD_CHUNK MB(1) // bytes read per pool worker at a time
+#define LOAD_PART_MIN KB(64) // fewest bytes decoded by a single part
+#define LOAD_QUEUE 16 // decoded chunks the worker may run ahead of buffer
+#define LOAD_TICK_BUDGET MSEC(12) // time spent appending chunks per tick
+
+// bytes of raw that can be decoded now. an incomplete code point and a '\r' that may
+// start a line ending are left for the next chunk, unless raw ends the file
+static usize _load_usable(struct load* l, const byte* raw, usize n, bool last) {
+  if (last) return n;
+  usize usable = utf8_complete_len(raw, n);
+  if (l->eol != eol_lf && usable > 0 && raw[usable - 1] == '\r') {
+    usable--;
+  }
+  return usable;
+}
+
+static void buffer_to_lf(Editor* ed);
+
+// settles the line ending on the first '\n' of the file, if raw has it. a crlf file that
+// turns out to have a bare '\n' is decoded as lf from there on, keeping its '\r' in
+// buffer, so that it is saved back the way it is. returns true if that happened after
+// chunks of it were decoded as crlf
+static bool _load_settle_eol(struct load* l, const byte* raw, usize n) {
+  bool decoded = l->eol == eol_crlf;
+  if (l->eol == eol_auto) {
+    const byte* nl = memchr(raw, '\n', n);
+    if (nl == NULL) return false;
+    l->eol = nl > raw && nl[-1] == '\r' ? eol_crlf : eol_lf; // a '\r' is never left in the chunk before
+  }
+  if (l->eol != eol_crlf || !lf_bare_bytes(raw, n)) return false;
+  l->eol = eol_lf;
+  return decoded;
+}
+
+// decodes n bytes into a chunk and locates its newlines. NULL if out of memory
+static struct load_chunk* _load_chunk(struct load* l, const byte* raw, usize n) {
+  struct load_chunk* chunk = mem_alloc(mem_text, sizeof(struct load_chunk) + sizeof(u32) * n);
+  if (chunk == NULL) return NULL;
+  enum eol eol = l->eol;
+  chunk->next = NULL;
+  chunk->bytes = n;
+  chunk->to_lf = false;
+  chunk->n = utf8_decode_text(raw, n, chunk->text, &eol);
+  chunk->starts = mem_alloc(mem_lines, sizeof(u32) * (lf_count(chunk->text, chunk->n) + 1));
+  if (chunk->starts == NULL) {
+    mem_free(mem_text, chunk);
+    return NULL;
+  }
+  chunk->nstarts = lf_index(chunk->text, chunk->n, 0, chunk->starts);
+  return chunk;
+}
+
+static inline void _load_chunk_free(struct load_chunk* chunk) {
+  mem_free(mem_lines, chunk->starts);
+  mem_free(mem_text, chunk);
+}
+
+struct load_part {
+  const byte* raw;
+  usize n;
+  struct load_chunk* chunk;
+};
+
+struct load_batch {
+  struct load* l;
+  struct load_part* parts;
+};
+
+static void _load_parts(void* arg, u32 part, usize begin, usize end) {
+  struct load_batch* b = arg;
+  (void)part;
+  for (usize i = begin; i < end; i++) {
+    b->parts[i].chunk = _load_chunk(b->l, b->parts[i].raw, b->parts[i].n);
+  }
+}
+
+// splits raw into at most max parts of about the same size. every part but the last ends
+// right after a '\n', so that neither a code point nor a line ending is split
+static u32 _load_cut(const byte* raw, usize n, struct load_part* parts, u32 max) {
+  u32 count = 0;
+  usize begin = 0;
+  for (u32 i = 1; i <= max && begin < n; i++) {
+    usize end = n;
+    if (i < max) {
+      const byte* nl = memchr(raw + MAX(n * i / max, begin), '\n', n - MAX(n * i / max, begin));
+      end = nl != NULL ? (usize)(nl - raw) + 1 : n;
+    }
+    parts[count++] = (struct load_part){ raw + begin, end - begin, NULL };
+    begin = end;
+  }
+  return count;
+}
+
+// reads a batch of LOAD_CHUNK per pool worker at a time, and decodes its parts in parallel
+static void* _load_worker(void* arg) {
+  struct load* l = arg;
+  u32 max = l->pool->nthreads;
+  struct load_part parts[max];
+  byte* raw = mem_alloc(mem_io, LOAD_CHUNK * max);
+  u64 off = l->offset;
+  while (raw != NULL && off < l->size && !atomic_load(&l->stop)) {
+    pthread_mutex_lock(&l->lock);
+    while (l->queued >= LOAD_QUEUE && !atomic_load(&l->stop)) {
+      pthread_cond_wait(&l->cond, &l->lock);
+    }
+    pthread_mutex_unlock(&l->lock);
+    if (atomic_load(&l->stop)) break;
+
+    usize want = MIN(LOAD_CHUNK * max, l->size - off), got = 0;
+    while (got < want) {
+      ssize_t res = pread(l->fd, raw + got, want - got, off + got);
+      if (res == -1 && errno == EINTR) continue;
+      if (res == -1) l->err = errno;
+      if (res <= 0) break; // file shrunk while loading
+      got += res;
+    }
+    usize usable = _load_usable(l, raw, got, got < want || off + got == l->size);
+    if (usable == 0) break;
+    bool to_lf = _load_settle_eol(l, raw, usable);
+    u32 n = _load_cut(raw, usable, parts, MIN(max, usable / LOAD_PART_MIN + 1));
+    struct load_batch batch = { l, parts };
+    pool_for(l->pool, n, 1, _load_parts, &batch);
+    if (parts[0].chunk != NULL) parts[0].chunk->to_lf = to_lf;
+
+    pthread_mutex_lock(&l->lock);
+    u64 newlines = 0;
+    for (u32 i = 0; i < n; i++) {
+      struct load_chunk* chunk = parts[i].chunk;
+      if (chunk == NULL || l->err != 0) { // nothing after a missing part may be appended
+        if (chunk != NULL) _load_chunk_free(chunk);
+        l->err = ENOMEM;
+        continue;
+      }
+      if (l->tail != NULL) {
+        l->tail->next = chunk;
+      } else {
+        l->head = chunk;
+      }
+      l->tail = chunk;
+      l->queued++;
+      newlines += chunk->nstarts;
+    }
+    pthread_cond_broadcast(&l->cond);
+    pthread_mutex_unlock(&l->lock);
+    wake_signal();
+    if (l->err != 0) break;
+    off += usable;
+    atomic_fetch_add(&l->newlines, newlines);
+    atomic_store(&l->decoded, off);
+  }
+  atomic_store(&l->counted, off == l->size);
+  if (raw == NULL) l->err = ENOMEM;
+  mem_free(mem_io, raw);
+  pthread_mutex_lock(&l->lock);
+  l->done = true;
+  pthread_cond_broadcast(&l->cond);
+  pthread_mutex_unlock(&l->lock);
+  wake_signal();
+  return NULL;
+}
+
+// takes the oldest decoded chunk. with wait, blocks until one is decoded. returns NULL
+// if there is none, or with wait, if the worker is done
+static struct load_chunk* _load_take(struct load* l, bool wait) {
+  pthread_mutex_lock(&l->lock);
+  while (wait && l->head == NULL && !l->done) {
+    pthread_cond_wait(&l->cond, &l->lock);
+  }
+  struct load_chunk* chunk = l->head;
+  if (chunk != NULL) {
+    l->head = chunk->next;
+    if (l->head == NULL) l->tail = NULL;
+    l->queued--;
+    pthread_cond_broadcast(&l->cond);
+  }
+  pthread_mutex_unlock(&l->lock);
+  return chunk;
+}
+
+// true if the main thread has chunks to append, or the worker is done
+static inline bool load_pending(struct load* l) {
+  pthread_mutex_lock(&l->lock);
+  bool pending = l->head != NULL || l->done;
+  pthread_mutex_unlock(&l->lock);
+  return pending;
+}
+
+static inline bool _load_drained(struct load* l) {
+  pthread_mutex_lock(&l->lock);
+  bool drained = l->head == NULL && l->done;
+  pthread_mutex_unlock(&l->lock);
+  return drained;
+}
+
+static void _load_append(Editor* ed, struct load_chunk* chunk) {
+  if (chunk->to_lf) {
+    buffer_to_lf(ed);
+  }
+  buffer_append_lines(ed, chunk->text, chunk->n, chunk->starts, chunk->nstarts);
+  ed->load.offset += chunk->bytes;
+  synced_add(&ed->synced, GAP_LEN(&ed->buffer), ed->load.offset);
+  _load_chunk_free(chunk);
+}
+
+static void _load_close(Editor* ed) {
+  struct load* l = &ed->load;
+  pthread_mutex_destroy(&l->lock);
+  pthread_cond_destroy(&l->cond);
+  close(l->fd);
+  l->active = false;
+  ed->eol = l->eol == eol_auto ? eol_lf : l->eol;
+  ed->watch.offset = l->offset;
+}
+
+// joins the worker once every chunk is in buffer
+static void _load_end(Editor* ed) {
+  struct load* l = &ed->load;
+  pthread_join(l->thread, NULL);
+  _load_close(ed);
+  if (l->err != 0) {
+    set_status(ed, st_warn, "load stopped at %llu bytes: %s", (unsigned long long)l->offset, strerror(l->err));
+  } else if (l->offset < l->size) {
+    set_status(ed, st_warn, "file shrunk while loading.");
+  }
+}
+
+// decodes the start of the file into buffer and loads the rest in background. returns
+// false, with a warning in status, if the file can't be read
+static bool load_start(Editor* ed) {
+  struct load* l = &ed->load;
+  *l = (struct load){ .fd = open(ed->bufname, O_RDONLY | O_CLOEXEC), .eol = eol_auto, .pool = ed->ws->pool };
+  atomic_init(&l->newlines, 0);
+  atomic_init(&l->decoded, 0);
+  atomic_init(&l->counted, false);
+  struct stat st;
+  if (l->fd == -1 || fstat(l->fd, &st) == -1) {
+    set_status(ed, st_warn, "open: %s", strerror(errno));
+    if (l->fd != -1) close(l->fd);
+    return false;
+  }
+  l->size = st.st_size;
+  gap_reserve(&ed->buffer, l->size);
+
+  usize want = MIN(LOAD_FIRST, l->size), got = 0;
+  byte raw[LOAD_FIRST];
+  while (got < want) {
+    ssize_t res = pread(l->fd, raw + got, want - got, got);
+    if (res == -1 && errno == EINTR) continue;
+    if (res <= 0) break;
+    got += res;
+  }
+  usize usable = _load_usable(l, raw, got, got < want || got == l->size);
+  _load_settle_eol(l, raw, usable);
+  struct load_chunk* chunk = _load_chunk(l, raw, usable);
+  if (chunk == NULL) {
+    set_status(ed, st_warn, "load_start: %s", strerror(ENOMEM));
+    close(l->fd);
+    return false;
+  }
+  atomic_store(&l->newlines, chunk->nstarts);
+  atomic_store(&l->decoded, usable);
+  _load_append(ed, chunk);
+
+  pthread_mutex_init(&l->lock, NULL);
+  pthread_cond_init(&l->cond, NULL);
+  atomic_init(&l->stop, false);
+  if (l->offset == l->size) {
+    _load_close(ed);
+  } else if (pthread_create(&l->thread, NULL, _load_worker, l) != 0) {
+    _load_close(ed);
+    set_status(ed, st_warn, "failed to start loader, file is shown partially.");
+  } else {
+    l->active = true;
+  }
+  return true;
+}
+
+// appends the chunks decoded since last tick, as many as fit the budget.
+// returns true if buffer grew
+static bool load_tick(Editor* ed) {
+  struct load* l = &ed->load;
+  if (!l->active) return false;
+  struct timespec begin;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  bool grew = false;
+  struct load_chunk* chunk;
+  while (elapsed_seconds(&begin) < LOAD_TICK_BUDGET && (chunk = _load_take(l, false)) != NULL) {
+    _load_append(ed, chunk);
+    grew = true;
+  }
+  if (!grew && _load_drained(l)) {
+    _load_end(ed);
+    return true;
+  }
+  return grew;
+}
+
+// blocks until line is in buffer, or the whole file is
+static void load_wait(Editor* ed, u32 line) {
+  struct load* l = &ed->load;
+  while (l->active && lncount(ed) <= line) {
+    struct load_chunk* chunk = _load_take(l, true);
+    if (chunk == NULL) {
+      _load_end(ed);
+      return;
+    }
+    _load_append(ed, chunk);
+  }
+}
+
+// blocks until the whole file is in buffer
+static inline void load_finish(Editor* ed) { load_wait(ed, UINT32_MAX); }
+
+// abandons loading, buffer keeps what was appended so far
+static void load_stop(Editor* ed) {
+  struct load* l = &ed->load;
+  if (!l->active) return;
+  atomic_store(&l->stop, true);
+  pthread_mutex_lock(&l->lock);
+  pthread_cond_broadcast(&l->cond);
+  pthread_mutex_unlock(&l->lock);
+  pthread_join(l->thread, NULL);
+  for (struct load_chunk* chunk = l->head; chunk != NULL;) {
+    struct load_chunk* next = chunk->next;
+    _load_chunk_free(chunk);
+    chunk = next;
+  }
+  pthread_mutex_destroy(&l->lock);
+  pthread_cond_destroy(&l->cond);
+  close(l->fd);
+  l->active = false;
+}
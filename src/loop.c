@@ -0,0 +1,79 @@
+#pragma once
+// event loop of a terminal editing on its own. it sleeps in poll until keys come in, a
+// worker signals include/wake.h, the watched file changes or its timer expires. the
+// timer goes off when editor_poll_interval asks for a tick, or when the next frame is
+// due: everything that happened since the last draw is drawn at once, at most once per
+// LOOP_FRAME.
+
+#include <poll.h>
+#include <sys/timerfd.h>
+
+#define LOOP_FRAME 16 // ms between two draws at least
+
+static inline i32 _loop_since(struct timespec* since) {
+  return (i32)(elapsed_seconds(since) * 1000);
+}
+
+// sets timer to go off in ms, or disarms it if ms is negative
+static void _loop_arm(int timer, i32 ms) {
+  struct itimerspec at = {0};
+  if (ms >= 0) {
+    at.it_value.tv_sec = ms / 1000;
+    at.it_value.tv_nsec = (ms % 1000) * 1000000L + 1; // zero would disarm it
+  }
+  if (timerfd_settime(timer, 0, &at, NULL) == -1) {
+    perror("timerfd_settime");
+    exit(-1);
+  }
+}
+
+static void loop_run(Editor* ed, WINDOW* win) {
+  int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer == -1) {
+    perror("timerfd_create");
+    exit(-1);
+  }
+  editor_draw(win, ed);
+  wrefresh(win);
+  struct timespec drawn;
+  clock_gettime(CLOCK_MONOTONIC, &drawn);
+  bool dirty = false;
+  wtimeout(win, 0);
+  while (!_has(ed->state, quit)) {
+    i32 wait = editor_poll_interval(ed);
+    if (dirty) {
+      i32 frame = MAX(LOOP_FRAME - _loop_since(&drawn), 0);
+      wait = wait < 0 ? frame : MIN(wait, frame);
+    }
+    _loop_arm(timer, wait > 0 ? wait : -1);
+    struct pollfd fds[] = {
+      { .fd = STDIN_FILENO, .events = POLLIN },
+      { .fd = wake_fd, .events = POLLIN },
+      { .fd = timer, .events = POLLIN },
+      { .fd = editor_watch_fd(ed), .events = POLLIN }, // ignored by poll if -1
+    };
+    if (poll(fds, sizeof(fds) / sizeof(fds[0]), wait == 0 ? 0 : -1) == -1 && errno != EINTR) {
+      perror("poll");
+      exit(-1);
+    }
+    u64 expired;
+    if (fds[1].revents & POLLIN) wake_drain();
+    if ((fds[2].revents & POLLIN) && read(timer, &expired, sizeof(expired)) == -1) {
+      // disarmed by now
+    }
+
+    u32 ch; // keys typed since, a resize interrupting poll comes in as KEY_RESIZE
+    while (!_has(ed->state, quit) && wget_wch(win, &ch) != ERR) {
+      editor_input(ed, ch);
+      dirty = true;
+    }
+    dirty |= editor_tick(ed);
+    if (dirty && _loop_since(&drawn) >= LOOP_FRAME) {
+      editor_draw(win, ed);
+      wrefresh(win);
+      clock_gettime(CLOCK_MONOTONIC, &drawn);
+      dirty = false;
+    }
+  }
+  close(timer);
+}
@@ -0,0 +1,151 @@
+#pragma once
+// keyboard macros. ctrl-k starts recording the keys typed into the buffer and ctrl-k
+// again stops it, ctrl-e replays them once. >macro replays them a number of times, or
+// once from the start of every line in a range. a replay is not drawn and sets no status
+// messages on the way. its edits skip the undo timeline and are recorded once it ends, as
+// a single replace of the span they changed, so the whole replay is undone at once. only
+// the old text of that span is kept, widened by every edit made outside of it.
+
+#define MACRO_INIT_SIZE 64 // keys recorded before growing
+
+// span of buffer a replay changed so far. [lo, hi) of buffer held len characters of old
+// before the replay, text around it is untouched
+struct macro_run {
+  u32* old;
+  u32 len, cap;
+  u32 lo, hi;
+  bool touched;
+};
+
+// keys acting on the editor rather than the text are left out of macros
+static inline bool _macro_skips(u32 ch) {
+  switch (ch) {
+    case CTRL('u'):
+    case CTRL('r'):
+    case CTRL('s'):
+    case CTRL('t'):
+    case CTRL('d'):
+    case CTRL('q'):
+      return true;
+    default: return false;
+  }
+}
+
+static void macro_toggle(Editor* ed) {
+  struct macro* m = &ed->ws->macro;
+  if (!m->recording) {
+    u32Da_reset(&m->keys);
+    m->recording = true;
+    set_status(ed, st_norm, "recording macro, ctrl-k to stop.");
+    return;
+  }
+  m->recording = false;
+  set_status(ed, st_norm, "recorded %zu keys, ctrl-e to replay.", m->keys.len);
+}
+
+// adds a key handed to editor_key while recording
+static inline void macro_record(Editor* ed, u32 ch) {
+  struct macro* m = &ed->ws->macro;
+  if (m->recording && !_macro_skips(ch)) {
+    u32Da_insert(&m->keys, ch, _END(0));
+  }
+}
+
+static bool _macro_begin(Editor* ed, struct macro_run* run) {
+  struct macro* m = &ed->ws->macro;
+  if (ed->mode != mode_edit) {
+    set_status(ed, st_warn, "buffer is read-only.");
+    return false;
+  } else if (m->recording) {
+    set_status(ed, st_warn, "stop recording before replaying.");
+    return false;
+  } else if (m->keys.len == 0) {
+    set_status(ed, st_warn, "no macro recorded, ctrl-k to record one.");
+    return false;
+  }
+  *run = (struct macro_run){0};
+  m->run = run;
+  _set(&ed->state, replaying | commit_action);
+  return true;
+}
+
+// widens the changed span over [start, end) of buffer, which is about to be replaced by
+// added characters. called by the raw edits while replaying
+static void macro_touch(Editor* ed, u32 start, u32 end, u32 added) {
+  struct macro_run* run = ed->ws->macro.run;
+  if (!run->touched) {
+    run->lo = run->hi = start;
+    run->touched = true;
+  }
+  u32 lo = MIN(start, run->lo), hi = MAX(end, run->hi);
+  u32 before = run->lo - lo, after = hi - run->hi;
+  if (run->len + before + after > run->cap) {
+    u32 cap = MAX(run->cap * 2, run->len + before + after + MACRO_INIT_SIZE);
+    u32* old = mem_realloc(mem_undo, run->old, sizeof(u32) * cap);
+    if (old == NULL) {
+      perror("macro_replay");
+      exit(-1);
+    }
+    run->old = old;
+    run->cap = cap;
+  }
+  memmove(run->old + before, run->old, sizeof(u32) * run->len);
+  gap_copy(&ed->buffer, lo, before, run->old);
+  gap_copy(&ed->buffer, run->hi, after, run->old + before + run->len);
+  run->len += before + after;
+  run->lo = lo;
+  run->hi = hi - (end - start) + added;
+}
+
+static inline void _macro_play(Editor* ed) {
+  struct macro* m = &ed->ws->macro;
+  for (usize i = 0; i < m->keys.len; i++) {
+    editor_key(ed, u32Da_get(&m->keys, i));
+  }
+}
+
+// records what the replay changed, between the text both sides of the span have in common
+static void _macro_end(Editor* ed, struct macro_run* run) {
+  _reset(&ed->state, replaying);
+  ed->ws->macro.run = NULL;
+  u32 len = run->hi - run->lo, pre = 0, suf = 0;
+  while (pre < run->len && pre < len && run->old[pre] == gap_get(&ed->buffer, run->lo + pre)) pre++;
+  while (suf < run->len - pre && suf < len - pre && run->old[run->len - 1 - suf] == gap_get(&ed->buffer, run->hi - 1 - suf)) {
+    suf++;
+  }
+  u32 removed = run->len - pre - suf, added = len - pre - suf, at = run->lo + pre;
+  if (removed > 0 || added > 0) {
+    u32 curs = cursi(ed);
+    curs_goto(ed, at + added); // storage of the new text is contiguous before the gap
+    timeline_record_replace(ed, at, run->old + pre, removed, ed->buffer.start + at, added);
+    curs_goto(ed, curs);
+  }
+  mem_free(mem_undo, run->old);
+}
+
+// replays the macro times times in a row
+static void macro_replay(Editor* ed, u32 times) {
+  struct macro_run run;
+  if (!_macro_begin(ed, &run)) return;
+  for (u32 i = 0; i < times; i++) {
+    _macro_play(ed);
+  }
+  _macro_end(ed, &run);
+  set_status(ed, st_norm, "replayed macro %u times.", times);
+}
+
+// replays the macro once from the start of every line in [first, last). lines are
+// counted as they were before the replay, whatever lines the macro adds or removes
+static void macro_replay_lines(Editor* ed, u32 first, u32 last) {
+  struct macro_run run;
+  if (!_macro_begin(ed, &run)) return;
+  u32 line = first, done = 0;
+  for (; done < last - first && line < lncount(ed); done++) {
+    u32 before = lncount(ed);
+    curs_goto(ed, lnbeg(ed, line));
+    _macro_play(ed);
+    line += 1 + (lncount(ed) - before);
+  }
+  _macro_end(ed, &run);
+  set_status(ed, st_norm, "replayed macro on %u lines.", done);
+}
@@ -4,8 +4,15 @@
 #ifndef _XOPEN_SOURCE_EXTENDED
 #define _XOPEN_SOURCE_EXTENDED
 #endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE // d_type of directory entries
+#endif
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // credentials of daemon clients, see daemon.c
+#endif
 
 #include <stdlib.h>
+#include <unistd.h>
 #include <locale.h>
 #include <ncursesw/ncurses.h>
 
@@ -26,14 +33,13 @@ void cleanup() {
   endwin();
 }
 
-i32 main(i32 argc, char** argv) {
-  setlocale(LC_ALL, "");
-  atexit(cleanup);
-  initscr();
+// sets up the current terminal for editing and returns the window editor draws in
+static WINDOW* term_init(void) {
   noecho();
   curs_set(0);
   keypad(stdscr, TRUE);
   cbreak();
+  set_escdelay(25); // escape closes the palette
   mousemask(BUTTON1_PRESSED |
             BUTTON1_RELEASED |
             REPORT_MOUSE_POSITION |
@@ -41,73 +47,105 @@ i32 main(i32 argc, char** argv) {
             BUTTON5_PRESSED |
             BUTTON_SHIFT, NULL);
 
-  edwin = newwin(LINES, COLS, 0, 0);
-  ed = editor_init(argv[1]);
-  keypad(edwin, TRUE);
+  WINDOW* win = newwin(LINES, COLS, 0, 0);
+  keypad(win, TRUE);
+  idlok(win, TRUE); // rows scrolled by editor_draw are moved by the terminal
 
   if (has_colors()) {
     start_color();
     set_theme(default_light);
-    wbkgd(edwin, COLOR_PAIR(EDITOR_PAIR) | ' ');
+    wbkgd(win, COLOR_PAIR(EDITOR_PAIR) | ' ');
   }
+  return win;
+}
+
+// handles a key read from the terminal of ed
+static void editor_input(Editor* ed, u32 ch) {
+  MEVENT mevnt;
+  if (ch == KEY_MOUSE) {
+    if (getmouse(&mevnt) == OK) {
+      if (mevnt.bstate & BUTTON1_PRESSED) {
+        // TODO
+      } else if (mevnt.bstate & BUTTON1_RELEASED) {
+        // TODO
+      } else if (ed->mode == mode_view) {
+        if (mevnt.bstate & BUTTON4_PRESSED) viewer_mov(ed, -3);
+        if (mevnt.bstate & BUTTON5_PRESSED) viewer_mov(ed, 3);
+      } else if (ed->mode == mode_hex) {
+        if (mevnt.bstate & BUTTON4_PRESSED) hex_mov(ed, -3 * (i64)ed->hex.per);
+        if (mevnt.bstate & BUTTON5_PRESSED) hex_mov(ed, 3 * ed->hex.per);
+      } else if (mevnt.bstate & BUTTON4_PRESSED) {
+        if (mevnt.bstate & BUTTON_SHIFT) {
+          curs_mov_left(ed, 3);            
+        } else {
+          curs_mov_up(ed, 3);
+        }
+      } else if (mevnt.bstate & BUTTON5_PRESSED) {
+        if (mevnt.bstate & BUTTON_SHIFT) {
+          curs_mov_right(ed, 3);
+        } else {
+          curs_mov_down(ed, 3);
+        }
+      }
+    }      
+  } else if (ch == KEY_RESIZE) {
+    // not a character, the next draw takes the new size and wraps lines again at it
+  } else if (ed->ws->palette.open) {
+    palette_key(ed, ch);
+  } else if (ch == KEY_F(2)) {
+    palette_open(ed);
+  } else if (ed->mode != mode_edit) {
+    if (ch == CTRL('q')) {
+      editor_exit(ed);
+    } else if (ed->mode == mode_hex) {
+      hex_key(ed, ch);
+    } else {
+      viewer_key(ed, ch);
+    }
+  } else if (ch == CTRL('k')) {
+    macro_toggle(ed);
+  } else if (ch == CTRL('e')) {
+    macro_replay(ed, 1);
+  } else {
+    macro_record(ed, ch);
+    editor_key(ed, ch);
+  }
+}
+
+#include "loop.c"
+#include "daemon.c"
+
+i32 main(i32 argc, char** argv) {
+  enum modes mode = mode_edit;
+  bool attach = false;
+  i32 opt;
+  while ((opt = getopt(argc, argv, "rxda")) != -1) {
+    switch (opt) {
+      case 'r': mode = mode_view; break;
+      case 'x': mode = mode_hex; break;
+      case 'd': return daemon_run();
+      case 'a': attach = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-r | -x] [-a] [file | directory]\n       %s -d\n", argv[0], argv[0]);
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (attach) { // edits locally if no daemon is running
+    i32 status = client_run(argv[optind], mode);
+    if (status >= 0) return status;
+  }
+
+  setlocale(LC_ALL, "");
+  atexit(cleanup);
+  initscr();
+  edwin = term_init();
+  ed = editor_init(argv[optind], mode, false);
 
   if (!has_ic()) {
       printf("Your terminal does not support insert character.\n");
       exit(EXIT_FAILURE);
   }
 
-  MEVENT mevnt;
-
-  editor_draw(edwin, ed);
-  wrefresh(edwin);
-  u32 ch;
-  do {
-    wget_wch(edwin, &ch);
-    if (ch == ERR) {
-      continue;
-    } else if (ch == KEY_MOUSE) {
-      if (getmouse(&mevnt) == OK) {
-        if (mevnt.bstate & BUTTON1_PRESSED) {
-          // TODO
-        } else if (mevnt.bstate & BUTTON1_RELEASED) {
-          // TODO
-        } else if (mevnt.bstate & BUTTON4_PRESSED) {
-          if (mevnt.bstate & BUTTON_SHIFT) {
-            curs_mov_left(ed, 3);            
-          } else {
-            curs_mov_up(ed, 3);
-          }
-        } else if (mevnt.bstate & BUTTON5_PRESSED) {
-          if (mevnt.bstate & BUTTON_SHIFT) {
-            curs_mov_right(ed, 3);
-          } else {
-            curs_mov_down(ed, 3);
-          }
-        }
-      }      
-    } else {
-      switch (ch) {
-        case KEY_LEFT: curs_mov_left(ed, 1); break;
-        case KEY_RIGHT: curs_mov_right(ed, 1); break;
-        case KEY_UP: curs_mov_up(ed, 1); break;
-        case KEY_DOWN: curs_mov_down(ed, 1); break;
-        case KEY_BACKSPACE: editor_removel(ed); break;
-        case KEY_DC: editor_remover(ed); break;
-        case '\n': editor_insert_newline(ed); break;
-        case '\t': editor_insert(ed, '\t'); break;
-        case CTRL('u'): editor_undo(ed); break;
-        case CTRL('r'): editor_redo(ed) ;break;
-        case CTRL('s'): write_to_file(ed); break;
-        case CTRL('q'): editor_exit(ed); break;
-        default:
-          if (ch >= 32)
-            editor_insert(ed, ch);
-          break;
-      }
-    }
-    editor_draw(edwin, ed);
-    wrefresh(edwin);
-  } while (1);
+  loop_run(ed, edwin);
   exit(EXIT_SUCCESS);
 }
-
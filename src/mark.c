@@ -0,0 +1,33 @@
+#pragma once
+// named marks on buffer positions, kept as anchors of include/anchor.h so they follow
+// every edit. ctrl-o and a letter sets mark of that letter at cursor, ctrl-g and a letter
+// jumps back to it. a mark inside removed text ends up where the removal was.
+
+static void mark_begin(Editor* ed, enum mark_wait wait) {
+  ed->marks.wait = wait;
+  set_status(ed, st_norm, wait == mark_set ? "set mark: a-z" : "jump to mark: a-z");
+}
+
+// takes the letter naming the mark after ctrl-o or ctrl-g
+static void mark_key(Editor* ed, u32 ch) {
+  struct marks* m = &ed->marks;
+  enum mark_wait wait = m->wait;
+  m->wait = mark_none;
+  if (ch < 'a' || ch > 'z') {
+    set_status(ed, st_warn, "marks are named a-z.");
+    return;
+  }
+  u32* id = &m->id[ch - 'a'];
+  if (wait == mark_set) {
+    if (*id != ANCHOR_NONE) anchor_drop(&ed->anchors, *id);
+    *id = anchor_add(&ed->anchors, cursi(ed));
+    set_status(ed, st_norm, "set mark %c at line %u.", ch, cursy(ed) + 1);
+    return;
+  }
+  if (*id == ANCHOR_NONE) {
+    set_status(ed, st_warn, "mark %c is not set.", ch);
+    return;
+  }
+  curs_goto(ed, MIN(anchor_pos(&ed->anchors, *id), GAP_LEN(&ed->buffer)));
+  set_status(ed, st_norm, "mark %c, line %u.", ch, cursy(ed) + 1);
+}
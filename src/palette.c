@@ -0,0 +1,345 @@
+#pragma once
+// command palette, opened with F2 over the top of the buffer.
+// plain text fuzzy finds files below the working directory and opens the chosen one.
+// text starting with '>' picks one of the commands below instead; anything after the
+// command name is handed to it as argument. >grep lists the lines containing a pattern
+// across those files, jumping to one opens its file at that line.
+
+#define PALETTE_ROWS 10 // results shown at once
+
+struct command {
+  const char* name;
+  const char* help;
+  void (*run)(Editor* ed, const char* args);
+};
+
+static void palette_refresh(Editor* ed);
+static void palette_key(Editor* ed, u32 ch);
+
+static void cmd_save(Editor* ed, const char* args) { (void)args; write_to_file(ed); }
+static void cmd_follow(Editor* ed, const char* args) { (void)args; watch_follow_toggle(ed); }
+static void cmd_diff(Editor* ed, const char* args) { (void)args; diff_toggle(ed); }
+static void cmd_wrap(Editor* ed, const char* args) { (void)args; wrap_toggle(ed); }
+static void cmd_quit(Editor* ed, const char* args) { (void)args; editor_exit(ed); }
+
+static void cmd_rescan(Editor* ed, const char* args) {
+  (void)args;
+  finder_scan(&ed->ws->finder, ed->ws->pool);
+  set_status(ed, st_norm, "rescanning working directory.");
+}
+
+static void cmd_grep(Editor* ed, const char* args) {
+  struct workspace* ws = ed->ws;
+  if (*args != '\0') {
+    if (ws->finder.root == -1) {
+      finder_scan(&ws->finder, ws->pool);
+    }
+    grep_start(&ws->grep, args);
+  } else if (ws->grep.plen == 0) {
+    set_status(ed, st_warn, "usage: >grep <text>");
+    return;
+  }
+  ws->palette.open = true; // empty argument shows results of the last search again
+  ws->palette.view = view_grep;
+  ws->palette.sel = 0;
+}
+
+static void cmd_sort(Editor* ed, const char* args) { lines_transform(ed, line_sort, args); }
+static void cmd_uniq(Editor* ed, const char* args) { lines_transform(ed, line_unique, args); }
+static void cmd_reverse(Editor* ed, const char* args) { lines_transform(ed, line_reverse, args); }
+static void cmd_keep(Editor* ed, const char* args) { lines_transform(ed, line_keep, args); }
+static void cmd_drop(Editor* ed, const char* args) { lines_transform(ed, line_drop, args); }
+
+static void cmd_pipe(Editor* ed, const char* args) { pipe_range(ed, args); }
+static void cmd_unfold(Editor* ed, const char* args) { (void)args; unfold_all(ed); }
+
+static void cmd_fold(Editor* ed, const char* args) {
+  if (ed->mode != mode_edit) {
+    set_status(ed, st_warn, "buffer is read-only.");
+  } else if (strcmp(args, "all") == 0) {
+    fold_all(ed);
+  } else {
+    fold_toggle(ed);
+  }
+}
+
+// "20" replays the macro 20 times, "5,80" on every line from 5 to 80 and "%" on all lines
+static void cmd_macro(Editor* ed, const char* args) {
+  if (*args == '%' || strchr(args, ',') != NULL) {
+    u32 first, last;
+    if (!_line_range(ed, &args, &first, &last)) {
+      set_status(ed, st_warn, "invalid line range.");
+      return;
+    }
+    macro_replay_lines(ed, first, last);
+    return;
+  }
+  unsigned long times = *args != '\0' ? strtoul(args, NULL, 10) : 1;
+  if (times == 0) {
+    set_status(ed, st_warn, "usage: >macro [times | first,last | %%]");
+    return;
+  }
+  macro_replay(ed, MIN(times, UINT32_MAX));
+}
+
+// bytes held per subsystem, also appended to the memory log if one is set
+static void cmd_mem(Editor* ed, const char* args) {
+  (void)args;
+  char summary[STLEN];
+  mem_summary(summary, STLEN);
+  mem_log("mem");
+  set_status(ed, st_norm, "%s", summary);
+}
+
+static void cmd_goto(Editor* ed, const char* args) {
+  unsigned long line = strtoul(args, NULL, 10);
+  if (line == 0 || ed->mode != mode_edit) {
+    set_status(ed, st_warn, "usage: >goto <line>");
+    return;
+  }
+  if (ed->load.active && atomic_load(&ed->load.counted) && line > atomic_load(&ed->load.newlines) + 1) {
+    set_status(ed, st_warn, "file has %llu lines.", atomic_load(&ed->load.newlines) + 1);
+    return;
+  }
+  load_wait(ed, MIN(line, UINT32_MAX) - 1);
+  curs_goto(ed, lnbeg(ed, MIN(line, lncount(ed)) - 1));
+}
+
+static void cmd_open(Editor* ed, const char* args) {
+  if (*args == '\0') {
+    set_status(ed, st_warn, "usage: >open <file>");
+    return;
+  }
+  editor_open(ed, (char*)args);
+}
+
+static const struct command commands[] = {
+  { "open", "open a file by path", cmd_open },
+  { "grep", "search text in every file", cmd_grep },
+  { "goto", "<line> move cursor to line", cmd_goto },
+  { "save", "write buffer to file", cmd_save },
+  { "follow", "follow appends to file", cmd_follow },
+  { "diff", "mark lines changed since last save", cmd_diff },
+  { "sort", "[first,last] [-n] [-r] sort lines", cmd_sort },
+  { "uniq", "[first,last] remove repeated lines", cmd_uniq },
+  { "reverse", "[first,last] reverse order of lines", cmd_reverse },
+  { "keep", "[first,last] <text> keep lines containing text", cmd_keep },
+  { "drop", "[first,last] <text> remove lines containing text", cmd_drop },
+  { "pipe", "[first,last] <command> filter lines through command", cmd_pipe },
+  { "fold", "[all] fold block at cursor, or all indented like it", cmd_fold },
+  { "unfold", "unfold every block", cmd_unfold },
+  { "wrap", "wrap long lines instead of scrolling sideways", cmd_wrap },
+  { "macro", "[times | first,last | %] replay recorded macro", cmd_macro },
+  { "rescan", "walk the working directory again", cmd_rescan },
+  { "mem", "show memory used per subsystem", cmd_mem },
+  { "quit", "close editor", cmd_quit },
+};
+#define NCOMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+static void palette_open(Editor* ed) {
+  struct palette* pal = &ed->ws->palette;
+  *pal = (struct palette){0};
+  pal->open = true;
+  if (ed->ws->finder.root == -1) { // first use, the file list is cached from now on
+    finder_scan(&ed->ws->finder, ed->ws->pool);
+  }
+  palette_refresh(ed);
+}
+
+static inline void palette_close(Editor* ed) { ed->ws->palette.open = false; }
+
+// splits a command query into its name and returns the argument after it
+static const char* _cmd_split(const char* query, const char** name, usize* len) {
+  *name = query + 1;
+  while (**name == ' ') (*name)++;
+  const char* end = *name;
+  while (*end != '\0' && *end != ' ') end++;
+  *len = end - *name;
+  while (*end == ' ') end++;
+  return end;
+}
+
+static inline u32 _palette_rows(Editor* ed) {
+  struct palette* pal = &ed->ws->palette;
+  if (pal->view == view_grep) return ed->ws->grep.nhits;
+  return pal->query[0] == '>' ? pal->ncmds : pal->files.n;
+}
+
+// recomputes results for the current query
+static void palette_refresh(Editor* ed) {
+  struct palette* pal = &ed->ws->palette;
+  struct finder* f = &ed->ws->finder;
+  if (pal->query[0] == '>') {
+    const char* name;
+    usize len;
+    _cmd_split(pal->query, &name, &len);
+    pal->ncmds = 0;
+    for (u32 i = 0; i < NCOMMANDS; i++) {
+      if (len <= strlen(commands[i].name) && strncmp(commands[i].name, name, len) == 0) {
+        pal->cmds[pal->ncmds++] = i;
+      }
+    }
+  } else {
+    finder_query(f, ed->ws->pool, pal->query, &pal->files);
+    pal->scored = f->count;
+  }
+  u32 rows = _palette_rows(ed);
+  pal->sel = rows == 0 ? 0 : MIN(pal->sel, rows - 1);
+}
+
+// merges paths and hits found in background. returns true if palette needs a redraw
+static bool palette_tick(Editor* ed) {
+  struct palette* pal = &ed->ws->palette;
+  bool walking = finder_walking(&ed->ws->finder);
+  bool merged = finder_merge(&ed->ws->finder);
+  bool grepped = grep_tick(&ed->ws->grep, &ed->ws->finder, ed->ws->pool);
+  if (!pal->open) return false;
+  if (pal->view == view_grep) return grepped || walking;
+  if (!merged && !walking) return false;
+  if (pal->query[0] != '>' && pal->scored != ed->ws->finder.count) {
+    palette_refresh(ed);
+  }
+  return true;
+}
+
+// opens the file of the selected hit at its line
+static void _palette_jump(Editor* ed) {
+  struct grep* g = &ed->ws->grep;
+  struct palette* pal = &ed->ws->palette;
+  if (pal->sel >= g->nhits) return;
+  const char* path = grep_path(g, pal->sel);
+  u32 line = g->hits[pal->sel].line;
+  palette_close(ed);
+  char file[PATH_MAX];
+  if (ed->resident) { // named by its absolute path
+    abs_path(path, file);
+  } else {
+    strncpy(file, path, PATH_MAX - 1);
+    file[PATH_MAX - 1] = '\0';
+  }
+  if (strcmp(ed->bufname, file) != 0) {
+    editor_open(ed, file);
+    if (strcmp(ed->bufname, file) != 0) return; // kept the unsaved buffer
+  }
+  if (ed->mode == mode_view) {
+    ed->viewer.curs = 0;
+    viewer_mov(ed, line);
+  } else {
+    load_wait(ed, line);
+    curs_goto(ed, lnbeg(ed, MIN(line, lncount(ed) - 1)));
+  }
+}
+
+static void _palette_grep_key(Editor* ed, u32 ch) {
+  struct palette* pal = &ed->ws->palette;
+  u32 rows = _palette_rows(ed);
+  switch (ch) {
+    case 27: // escape
+    case KEY_F(2): palette_close(ed); return;
+    case KEY_UP: if (pal->sel > 0) pal->sel--; return;
+    case KEY_DOWN: if (pal->sel + 1 < rows) pal->sel++; return;
+    case KEY_PPAGE: pal->sel -= MIN(pal->sel, PALETTE_ROWS); return;
+    case KEY_NPAGE: pal->sel = rows == 0 ? 0 : MIN(pal->sel + PALETTE_ROWS, rows - 1); return;
+    case '\n': _palette_jump(ed); return;
+  }
+  // editing goes back to the query the search was started with
+  pal->view = view_query;
+  pal->len = snprintf(pal->query, STLEN, ">grep %s", ed->ws->grep.pattern);
+  pal->len = MIN(pal->len, STLEN - 1);
+  pal->sel = 0;
+  palette_key(ed, ch);
+}
+
+static void palette_accept(Editor* ed) {
+  struct palette* pal = &ed->ws->palette;
+  if (pal->query[0] == '>') {
+    if (pal->ncmds == 0) {
+      set_status(ed, st_warn, "no such command.");
+      return;
+    }
+    const char* name;
+    usize len;
+    const char* args = _cmd_split(pal->query, &name, &len);
+    palette_close(ed);
+    commands[pal->cmds[pal->sel]].run(ed, args);
+  } else if (pal->files.n > 0) {
+    char path[PATH_MAX];
+    strncpy(path, finder_path(&ed->ws->finder, pal->files.idx[pal->sel]), PATH_MAX - 1);
+    path[PATH_MAX - 1] = '\0';
+    palette_close(ed);
+    editor_open(ed, path);
+  }
+}
+
+static void palette_key(Editor* ed, u32 ch) {
+  struct palette* pal = &ed->ws->palette;
+  if (pal->view == view_grep) {
+    _palette_grep_key(ed, ch);
+    return;
+  }
+  switch (ch) {
+    case 27: // escape
+    case KEY_F(2): palette_close(ed); return;
+    case KEY_UP: if (pal->sel > 0) pal->sel--; return;
+    case KEY_DOWN: if (pal->sel + 1 < _palette_rows(ed)) pal->sel++; return;
+    case '\n': palette_accept(ed); return;
+    case KEY_BACKSPACE:
+    case 127:
+      while (pal->len > 0 && (pal->query[--pal->len] & 0xC0) == 0x80); // whole code point
+      pal->query[pal->len] = '\0';
+      pal->sel = 0;
+      break;
+    default:
+      if (ch < 32 || ch > 0x10FFFF || pal->len + utf8_len(ch) >= STLEN) return;
+      pal->len += utf8_encode(ch, (byte*)pal->query + pal->len);
+      pal->query[pal->len] = '\0';
+      pal->sel = 0;
+      break;
+  }
+  palette_refresh(ed);
+}
+
+static void palette_draw(WINDOW* edwin, Editor* ed, u16 win_h, u16 win_w) {
+  struct palette* pal = &ed->ws->palette;
+  struct finder* f = &ed->ws->finder;
+  struct grep* g = &ed->ws->grep;
+  bool cmd = pal->query[0] == '>';
+  u32 rows = MIN(_palette_rows(ed), MIN(PALETTE_ROWS, win_h - 2));
+  u32 first = pal->sel >= rows ? pal->sel - rows + 1 : 0;
+
+  wattron(edwin, COLOR_PAIR(STATLN_PAIR));
+  mvwhline(edwin, 1, 0, ' ', win_w);
+  char info[STLEN];
+  if (pal->view == view_grep) {
+    snprintf(info, STLEN, "%u hits in %u/%u files%s", g->nhits, atomic_load(&g->scanned), f->count,
+      g->active ? " ..." : "");
+  } else if (cmd) {
+    snprintf(info, STLEN, "%u commands", pal->ncmds);
+  } else {
+    snprintf(info, STLEN, "%u/%u files%s", pal->files.n, f->count, finder_walking(f) ? " ..." : "");
+  }
+  mvwprintw(edwin, 1, MAX(0, win_w - (i32)strlen(info) - 1), "%s", info);
+  mvwprintw(edwin, 1, 1, " F2 ");
+  if (pal->view == view_grep) {
+    wprintw(edwin, ">grep %.*s", (int)MAX(0, win_w - (i32)strlen(info) - 14), g->pattern);
+  } else {
+    waddnstr(edwin, pal->query, MAX(0, win_w - (i32)strlen(info) - 8));
+  }
+  for (u32 r = 0; r < rows; r++) {
+    u32 i = first + r;
+    mvwhline(edwin, r + 2, 0, ' ', win_w);
+    if (i == pal->sel) wattron(edwin, A_REVERSE);
+    if (pal->view == view_grep) {
+      mvwprintw(edwin, r + 2, 2, "%s:%u: ", grep_path(g, i), g->hits[i].line + 1);
+      i32 x = getcurx(edwin);
+      waddnstr(edwin, grep_text(g, i), MAX(0, win_w - x - 1));
+    } else if (cmd) {
+      const struct command* c = &commands[pal->cmds[i]];
+      mvwprintw(edwin, r + 2, 2, ">%-10s %.*s", c->name, (int)MAX(0, win_w - 16), c->help);
+    } else {
+      mvwaddnstr(edwin, r + 2, 2, finder_path(f, pal->files.idx[i]), MAX(0, win_w - 3));
+    }
+    if (i == pal->sel) wattroff(edwin, A_REVERSE);
+  }
+  wattroff(edwin, COLOR_PAIR(STATLN_PAIR));
+}
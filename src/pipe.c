@@ -0,0 +1,246 @@
+#pragma once
+// filters a range of lines through a shell command, like ">pipe 10,20 sort -u".
+// the range is encoded chunk by chunk straight out of the gap segments into the stdin of
+// the command, while its output is read and decoded as it comes. poll drives both ends,
+// so a command writing before it has read all of its input never deadlocks. it watches
+// the terminal too, ctrl-c or escape there stops the command and leaves the range as is.
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <termios.h>
+
+#define PIPE_CHUNK KB(16) // code points encoded per write to the command
+#define PIPE_READ KB(64) // bytes read from the command at once
+
+struct pipe_out {
+  u32* text; // decoded output
+  usize len, cap;
+  byte pending[4]; // bytes of an incomplete sequence, or a '\r' that may start a crlf
+  u8 npending;
+};
+
+// decodes n bytes of output, holding back a possibly cut off end
+static bool _pipe_decode(struct pipe_out* out, byte* raw, usize n, enum eol eol, bool last) {
+  usize usable = last ? n : utf8_complete_len(raw, n);
+  if (!last && eol == eol_crlf && usable > 0 && raw[usable - 1] == '\r') usable--;
+  if (out->len + usable > out->cap) {
+    usize cap = MAX(out->cap * 2, out->len + usable + KB(4));
+    u32* text = mem_realloc(mem_io, out->text, sizeof(u32) * cap);
+    if (text == NULL) return false;
+    out->text = text;
+    out->cap = cap;
+  }
+  out->len += utf8_decode_text(raw, usable, out->text + out->len, &eol);
+  out->npending = n - usable;
+  memcpy(out->pending, raw + usable, out->npending);
+  return true;
+}
+
+// pipe whose ends are not inherited by the command, besides the dup'ed ones
+static bool _pipe_open(int fds[2]) {
+  return pipe2(fds, O_CLOEXEC) == 0;
+}
+
+// runs cmd through the shell with the given pipe ends as its standard streams. it leads
+// a process group of its own, so that a pipeline can be stopped as a whole
+static pid_t _pipe_spawn(const char* cmd, int in, int out, int err) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    setpgid(0, 0);
+    if (dup2(in, STDIN_FILENO) == -1 || dup2(out, STDOUT_FILENO) == -1 || dup2(err, STDERR_FILENO) == -1) {
+      _exit(127);
+    }
+    struct sigaction dfl = { .sa_handler = SIG_DFL };
+    sigaction(SIGPIPE, &dfl, NULL); // ignored signals stay ignored across exec
+    execl("/bin/sh", "sh", "-c", cmd, (char*)NULL);
+    _exit(127);
+  }
+  if (pid != -1) setpgid(pid, pid); // whichever side runs first
+  return pid;
+}
+
+// true if keys read from the terminal ask to stop the command. an escape only counts
+// alone, it also starts the sequences of arrows and such
+static inline bool _pipe_cancels(const byte* keys, ssize_t n) {
+  return memchr(keys, CTRL('c'), n) != NULL || (n == 1 && keys[0] == 0x1b);
+}
+
+// replaces a range of lines by the output of a command reading them
+static void pipe_range(Editor* ed, const char* args) {
+  if (ed->mode != mode_edit) {
+    set_status(ed, st_warn, "buffer is read-only.");
+    return;
+  }
+  u32 first, last;
+  if (!_line_range(ed, &args, &first, &last) || *args == '\0') {
+    set_status(ed, st_warn, "usage: >pipe [first,last] <command>");
+    return;
+  }
+  u32 start = lnbeg(ed, first), end = last > first ? lnend(ed, last - 1) : start;
+  int in[2], out[2], err[2];
+  if (!_pipe_open(in)) goto failed;
+  if (!_pipe_open(out)) {
+    close(in[0]);
+    close(in[1]);
+    goto failed;
+  }
+  if (!_pipe_open(err)) {
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+    goto failed;
+  }
+  struct sigaction ignore = { .sa_handler = SIG_IGN }, prev;
+  sigaction(SIGPIPE, &ignore, &prev); // the command may exit without reading everything
+  int tty = ed->ws->tty;
+  struct termios saved, keys;
+  bool restore = tty != -1 && tcgetattr(tty, &saved) == 0;
+  if (restore) { // ctrl-c comes in as a key rather than interrupting the editor
+    keys = saved;
+    keys.c_lflag &= ~ISIG;
+    tcsetattr(tty, TCSANOW, &keys);
+  }
+  pid_t pid = _pipe_spawn(args, in[0], out[1], err[1]);
+  close(in[0]);
+  close(out[1]);
+  close(err[1]);
+  fcntl(in[1], F_SETFL, O_NONBLOCK);
+  fcntl(out[0], F_SETFL, O_NONBLOCK);
+  fcntl(err[0], F_SETFL, O_NONBLOCK);
+
+  // range as it lies in the gap segments, followed by the ending of its last line
+  GapBuffer* gap = &ed->buffer;
+  u32 eol_mark = '\n';
+  struct { const u32* at; u32 len; } segments[] = {
+    { gap->start + MIN(start, gap->c), MIN(end, gap->c) - MIN(start, gap->c) },
+    { gap->start + GAP_GET_BUFFER_INDEX(gap, MAX(start, gap->c)), MAX(end, gap->c) - MAX(start, gap->c) },
+    { &eol_mark, 1 },
+  };
+  enum eol eol = ed->eol == eol_crlf ? eol_crlf : eol_lf;
+  byte* chunk = mem_alloc(mem_io, PIPE_CHUNK * 4 + PIPE_CHUNK);
+  byte* raw = mem_alloc(mem_io, PIPE_READ + 4);
+  struct pipe_out res = {0};
+  char msg[STLEN] = "";
+  usize msg_len = 0;
+  u32 seg = 0, seg_at = 0;
+  usize chunk_len = 0, chunk_at = 0;
+  bool ok = pid != -1 && chunk != NULL && raw != NULL, cancelled = false;
+  struct pollfd fds[4] = {
+    { in[1], POLLOUT, 0 },
+    { out[0], POLLIN, 0 },
+    { err[0], POLLIN, 0 },
+    { tty, POLLIN, 0 }, // ignored by poll if -1
+  };
+  while (ok && (fds[0].fd != -1 || fds[1].fd != -1 || fds[2].fd != -1)) {
+    if (poll(fds, 4, -1) == -1) {
+      if (errno == EINTR) continue;
+      ok = false;
+      break;
+    }
+    if (fds[0].revents & (POLLOUT | POLLERR | POLLHUP)) {
+      while (true) {
+        if (chunk_at == chunk_len) { // encode the next chunk of the range
+          while (seg < 3 && seg_at == segments[seg].len) {
+            seg++;
+            seg_at = 0;
+          }
+          if (seg == 3) break;
+          u32 n = MIN(PIPE_CHUNK, segments[seg].len - seg_at);
+          chunk_len = utf8_encode_text(segments[seg].at + seg_at, n, chunk, eol);
+          chunk_at = 0;
+          seg_at += n;
+        }
+        ssize_t w = write(fds[0].fd, chunk + chunk_at, chunk_len - chunk_at);
+        if (w == -1 && errno == EINTR) continue;
+        if (w == -1 && errno == EAGAIN) break;
+        if (w == -1) { // command does not read any more
+          seg = 3;
+          chunk_at = chunk_len;
+          break;
+        }
+        chunk_at += w;
+      }
+      if (seg == 3 && chunk_at == chunk_len) {
+        close(fds[0].fd);
+        fds[0].fd = -1;
+      }
+    }
+    if (fds[1].revents & (POLLIN | POLLERR | POLLHUP)) {
+      memcpy(raw, res.pending, res.npending);
+      ssize_t r = read(fds[1].fd, raw + res.npending, PIPE_READ);
+      if (r == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+      if (r <= 0 || !_pipe_decode(&res, raw, res.npending + r, eol, false)) {
+        ok &= r == 0 && _pipe_decode(&res, raw, res.npending, eol, true);
+        close(fds[1].fd);
+        fds[1].fd = -1;
+      }
+    }
+    if (fds[2].revents & (POLLIN | POLLERR | POLLHUP)) {
+      char tmp[512];
+      ssize_t r = read(fds[2].fd, tmp, sizeof(tmp));
+      if (r == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+      if (r <= 0) {
+        close(fds[2].fd);
+        fds[2].fd = -1;
+      } else if (msg_len < STLEN - 1) { // first error line is shown on failure
+        usize n = MIN((usize)r, STLEN - 1 - msg_len);
+        memcpy(msg + msg_len, tmp, n);
+        msg_len += n;
+      }
+    }
+    if (fds[3].revents & (POLLIN | POLLERR | POLLHUP)) { // keys typed meanwhile are dropped
+      byte typed[64];
+      ssize_t r = read(fds[3].fd, typed, sizeof(typed));
+      if (r == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+      if (r <= 0) {
+        fds[3].fd = -1;
+      } else if (_pipe_cancels(typed, r)) {
+        kill(-pid, SIGTERM);
+        cancelled = true;
+        ok = false;
+      }
+    }
+  }
+  for (u8 i = 0; i < 3; i++) {
+    if (fds[i].fd != -1) close(fds[i].fd);
+  }
+  int status = 0;
+  if (pid != -1) {
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR);
+  }
+  sigaction(SIGPIPE, &prev, NULL);
+  if (restore) tcsetattr(tty, TCSANOW, &saved);
+  mem_free(mem_io, chunk);
+  mem_free(mem_io, raw);
+
+  msg[msg_len] = '\0';
+  msg[strcspn(msg, "\n")] = '\0';
+  if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    if (cancelled) {
+      set_status(ed, st_warn, "pipe: cancelled.");
+    } else if (ok && WIFEXITED(status)) {
+      set_status(ed, st_warn, "pipe: exit %d %s", WEXITSTATUS(status), msg);
+    } else {
+      set_status(ed, st_warn, "pipe: command failed.");
+    }
+    mem_free(mem_io, res.text);
+    return;
+  }
+  if (res.len > 0 && res.text[res.len - 1] == '\n') {
+    res.len--; // range itself ends before the ending of its last line
+  } else if (res.len == 0 && end < GAP_LEN(gap)) { // no output at all, lines are gone
+    end++;
+  } else if (res.len == 0 && start > 0) {
+    start--;
+  }
+  editor_replace(ed, start, end, res.text, res.len);
+  curs_goto(ed, start);
+  mem_free(mem_io, res.text);
+  set_status(ed, st_norm, "piped %u lines through %s", last - first, args);
+  return;
+
+  failed:
+  set_status(ed, st_warn, "pipe: %s", strerror(errno));
+}
@@ -0,0 +1,318 @@
+#pragma once
+// whole buffer (or line range) transforms: sort, unique, reverse, keep and drop.
+// lines are handled as slices pointing straight into the buffer storage, which is
+// contiguous once the gap is moved past the range. only the result is built as new
+// text, and it replaces the range in a single edit and a single undo step.
+
+#define SORT_PART_MIN KB(8) // fewest lines sorted by a single task
+#define SORT_INSERTION 16 // runs this short are sorted by insertion
+
+struct line_slice {
+  const u32* s;
+  u32 len;
+  u32 idx; // line number inside the range, keeps equal lines in order
+};
+
+struct line_job {
+  struct line_slice* v;
+  struct line_slice* tmp;
+  usize n;
+  u32 parts; // sorted runs, as split by pool_for
+  u32 width; // runs merged together by a merge round are width runs apart
+  bool numeric, descending;
+  const u32* pat; // pattern of keep and drop
+  u32 plen;
+  u8* keep;
+  u64* hash;
+};
+
+// leading number of a line, like sort -n reads it. lines without one count as 0
+static double _slice_number(const struct line_slice* l) {
+  u32 i = 0;
+  while (i < l->len && (l->s[i] == ' ' || l->s[i] == '\t')) i++;
+  bool neg = i < l->len && l->s[i] == '-';
+  i += neg;
+  double num = 0, scale = 0;
+  for (; i < l->len; i++) {
+    if (l->s[i] == '.' && scale == 0) {
+      scale = 1;
+    } else if (l->s[i] >= '0' && l->s[i] <= '9') {
+      num = num * 10 + (l->s[i] - '0');
+      scale *= 10;
+    } else {
+      break;
+    }
+  }
+  if (scale > 0) num /= scale;
+  return neg ? -num : num;
+}
+
+static inline i32 _slice_cmp(struct line_job* j, const struct line_slice* x, const struct line_slice* y) {
+  i32 res = 0;
+  if (j->numeric) {
+    double a = _slice_number(x), b = _slice_number(y);
+    res = (a > b) - (a < b);
+  }
+  for (u32 i = 0; res == 0 && i < x->len && i < y->len; i++) { // by code point
+    res = (x->s[i] > y->s[i]) - (x->s[i] < y->s[i]);
+  }
+  if (res == 0) res = (x->len > y->len) - (x->len < y->len);
+  if (j->descending) res = -res;
+  return res != 0 ? res : (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+// merges sorted v[lo, mid) and v[mid, hi) through tmp
+static void _slice_merge(struct line_job* j, usize lo, usize mid, usize hi) {
+  if (mid == lo || mid == hi || _slice_cmp(j, &j->v[mid - 1], &j->v[mid]) <= 0) return;
+  memcpy(j->tmp + lo, j->v + lo, sizeof(struct line_slice) * (mid - lo));
+  usize a = lo, b = mid, out = lo;
+  while (a < mid && b < hi) {
+    j->v[out++] = _slice_cmp(j, &j->tmp[a], &j->v[b]) <= 0 ? j->tmp[a++] : j->v[b++];
+  }
+  memcpy(j->v + out, j->tmp + a, sizeof(struct line_slice) * (mid - a)); // rest of v is in place
+}
+
+static void _slice_sort(struct line_job* j, usize lo, usize hi) {
+  if (hi - lo <= SORT_INSERTION) {
+    for (usize i = lo + 1; i < hi; i++) {
+      struct line_slice l = j->v[i];
+      usize k = i;
+      for (; k > lo && _slice_cmp(j, &j->v[k - 1], &l) > 0; k--) {
+        j->v[k] = j->v[k - 1];
+      }
+      j->v[k] = l;
+    }
+    return;
+  }
+  usize mid = lo + (hi - lo) / 2;
+  _slice_sort(j, lo, mid);
+  _slice_sort(j, mid, hi);
+  _slice_merge(j, lo, mid, hi);
+}
+
+static void _sort_part(void* arg, u32 part, usize begin, usize end) {
+  (void)part;
+  _slice_sort(arg, begin, end);
+}
+
+// start of sorted run p, the way pool_for split the lines
+static inline usize _run_start(struct line_job* j, u32 p) { return j->n * MIN(p, j->parts) / j->parts; }
+
+static void _merge_part(void* arg, u32 part, usize begin, usize end) {
+  (void)part;
+  struct line_job* j = arg;
+  for (usize m = begin; m < end; m++) {
+    u32 first = m * 2 * j->width;
+    _slice_merge(j, _run_start(j, first), _run_start(j, first + j->width), _run_start(j, first + 2 * j->width));
+  }
+}
+
+// sorts runs in parallel, then merges pairs of runs in parallel until one is left
+static void lines_sort(struct line_job* j, Pool* pool) {
+  j->parts = pool_parts(pool, j->n, SORT_PART_MIN);
+  pool_for(pool, j->n, SORT_PART_MIN, _sort_part, j);
+  for (j->width = 1; j->width < j->parts; j->width *= 2) {
+    u32 merges = (j->parts + 2 * j->width - 1) / (2 * j->width);
+    pool_for(pool, merges, 1, _merge_part, j);
+  }
+}
+
+static inline u64 _slice_hash(const struct line_slice* l) {
+  u64 h = 0xcbf29ce484222325ULL;
+  for (u32 i = 0; i < l->len; i++) {
+    h = (h ^ l->s[i]) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static void _hash_part(void* arg, u32 part, usize begin, usize end) {
+  (void)part;
+  struct line_job* j = arg;
+  for (usize i = begin; i < end; i++) {
+    j->hash[i] = _slice_hash(&j->v[i]);
+  }
+}
+
+static inline bool _slice_eq(const struct line_slice* x, const struct line_slice* y) {
+  return x->len == y->len && memcmp(x->s, y->s, sizeof(u32) * x->len) == 0;
+}
+
+// keeps the first occurrence of every line. returns the number of lines left
+static usize lines_unique(struct line_job* j, Pool* pool) {
+  j->hash = mem_alloc(mem_misc, sizeof(u64) * j->n);
+  usize cap = 16;
+  while (cap < j->n * 2) cap *= 2;
+  u32* table = mem_alloc(mem_misc, sizeof(u32) * cap); // index + 1 of a kept line, 0 if empty
+  if (j->hash == NULL || table == NULL) {
+    perror("lines_unique");
+    exit(-1);
+  }
+  memset(table, 0, sizeof(u32) * cap);
+  pool_for(pool, j->n, SORT_PART_MIN, _hash_part, j);
+  usize kept = 0;
+  for (usize i = 0; i < j->n; i++) {
+    usize at = j->hash[i] & (cap - 1);
+    for (; table[at] != 0; at = (at + 1) & (cap - 1)) {
+      u32 k = table[at] - 1;
+      if (j->hash[k] == j->hash[i] && _slice_eq(&j->v[k], &j->v[i])) break;
+    }
+    if (table[at] != 0) continue; // seen before
+    table[at] = kept + 1;
+    j->hash[kept] = j->hash[i];
+    j->v[kept++] = j->v[i];
+  }
+  mem_free(mem_misc, table);
+  mem_free(mem_misc, j->hash);
+  return kept;
+}
+
+static void _filter_part(void* arg, u32 part, usize begin, usize end) {
+  (void)part;
+  struct line_job* j = arg;
+  for (usize i = begin; i < end; i++) {
+    const struct line_slice* l = &j->v[i];
+    bool found = j->plen == 0;
+    for (u32 at = 0; !found && at + j->plen <= l->len; at++) {
+      found = l->s[at] == j->pat[0] && memcmp(l->s + at, j->pat, sizeof(u32) * j->plen) == 0;
+    }
+    j->keep[i] = found;
+  }
+}
+
+// keeps lines containing the pattern, or the others if drop. returns the lines left
+static usize lines_filter(struct line_job* j, Pool* pool, bool drop) {
+  j->keep = mem_alloc(mem_misc, j->n);
+  if (j->keep == NULL) {
+    perror("lines_filter");
+    exit(-1);
+  }
+  pool_for(pool, j->n, SORT_PART_MIN, _filter_part, j);
+  usize kept = 0;
+  for (usize i = 0; i < j->n; i++) {
+    if (j->keep[i] != drop) j->v[kept++] = j->v[i];
+  }
+  mem_free(mem_misc, j->keep);
+  return kept;
+}
+
+enum line_op { line_sort, line_unique, line_reverse, line_keep, line_drop };
+
+// reads an optional leading line range "first[,last]" (1 based) from args. defaults to
+// every line, except an empty last line, which is just the end of the final line
+static bool _line_range(Editor* ed, const char** args, u32* first, u32* last) {
+  if (**args < '0' || **args > '9') {
+    load_finish(ed);
+    *first = 0;
+    *last = lncount(ed);
+    if (*last > 1 && lnlen(ed, *last - 1) == 0) (*last)--;
+    return true;
+  }
+  char* end;
+  unsigned long a = strtoul(*args, &end, 10), b = a;
+  if (*end == ',') b = strtoul(end + 1, &end, 10);
+  load_wait(ed, MIN(b, UINT32_MAX) - 1); // only lines up to the range have to be in
+  if (a == 0 || b < a || a > lncount(ed)) return false;
+  *first = a - 1;
+  *last = MIN(b, lncount(ed));
+  while (*end == ' ') end++;
+  *args = end;
+  return true;
+}
+
+// applies op to a range of lines, given by the start of args
+static void lines_transform(Editor* ed, enum line_op op, const char* args) {
+  if (ed->mode != mode_edit) {
+    set_status(ed, st_warn, "buffer is read-only.");
+    return;
+  }
+  u32 first, last;
+  if (!_line_range(ed, &args, &first, &last)) {
+    set_status(ed, st_warn, "invalid line range.");
+    return;
+  }
+  struct line_job j = { .n = last - first };
+  if (j.n == 0) return;
+  u32 start = lnbeg(ed, first), end = lnend(ed, last - 1);
+  curs_goto(ed, end); // storage of the range is contiguous before the gap
+  const u32* text = ed->buffer.start;
+
+  u32 pat[STLEN];
+  if (op == line_sort) {
+    while (*args == '-') { // -n numeric, -r descending
+      for (args++; *args != '\0' && *args != ' '; args++) {
+        j.numeric |= *args == 'n';
+        j.descending |= *args == 'r';
+      }
+      while (*args == ' ') args++;
+    }
+  } else if (op == line_keep || op == line_drop) {
+    usize len = strlen(args);
+    if (len == 0) {
+      set_status(ed, st_warn, "usage: >%s [first,last] <text>", op == line_keep ? "keep" : "drop");
+      return;
+    }
+    while (len > 0 && j.plen < STLEN) {
+      usize used = utf8_decode((const byte*)args, len, &pat[j.plen++]);
+      args += used;
+      len -= used;
+    }
+    j.pat = pat;
+  }
+
+  j.v = mem_alloc(mem_misc, sizeof(struct line_slice) * j.n);
+  j.tmp = mem_alloc(mem_misc, sizeof(struct line_slice) * j.n);
+  if (j.v == NULL || j.tmp == NULL) {
+    perror("lines_transform");
+    exit(-1);
+  }
+  for (u32 i = 0; i < j.n; i++) {
+    u32 beg = lnbeg(ed, first + i);
+    j.v[i] = (struct line_slice){ text + beg, lnend(ed, first + i) - beg, i };
+  }
+  usize n = j.n;
+  switch (op) {
+    case line_sort: lines_sort(&j, ed->ws->pool); break;
+    case line_unique: n = lines_unique(&j, ed->ws->pool); break;
+    case line_keep: n = lines_filter(&j, ed->ws->pool, false); break;
+    case line_drop: n = lines_filter(&j, ed->ws->pool, true); break;
+    case line_reverse:
+      for (usize i = 0; i < n / 2; i++) {
+        struct line_slice l = j.v[i];
+        j.v[i] = j.v[n - 1 - i];
+        j.v[n - 1 - i] = l;
+      }
+      break;
+  }
+
+  usize size = 0;
+  for (usize i = 0; i < n; i++) {
+    size += j.v[i].len + 1;
+  }
+  u32* out = mem_alloc(mem_text, sizeof(u32) * (size + 1));
+  if (out == NULL) {
+    perror("lines_transform");
+    exit(-1);
+  }
+  usize at = 0;
+  for (usize i = 0; i < n; i++) {
+    memcpy(out + at, j.v[i].s, sizeof(u32) * j.v[i].len);
+    at += j.v[i].len;
+    out[at++] = '\n';
+  }
+  at -= at > 0; // no line ending after the last line of range
+  if (n == 0 && end < GAP_LEN(&ed->buffer)) { // every line is gone, with its line ending
+    end++;
+  } else if (n == 0 && start > 0) {
+    start--;
+  }
+  mem_free(mem_misc, j.v);
+  mem_free(mem_misc, j.tmp);
+  editor_replace(ed, start, end, out, at); // out does not point into buffer
+  mem_free(mem_text, out);
+  curs_goto(ed, start);
+  if (op == line_sort || op == line_reverse) {
+    set_status(ed, st_norm, "%s %u lines.", op == line_sort ? "sorted" : "reversed", (u32)n);
+  } else {
+    set_status(ed, st_norm, "removed %u of %u lines.", (u32)(j.n - n), (u32)j.n);
+  }
+}
@@ -0,0 +1,227 @@
+#pragma once
+// read-only viewer for files too large to be decoded into buffer.
+// only the lines on screen are decoded, straight from a mapped window of the file.
+// memory use is bounded by the window and the sparse line index, not by the file size.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#define VIEWER_THRESHOLD MB(256) // larger files are opened in viewer mode
+#define VIEWER_WINDOW MB(8) // bytes of the file mapped at a time
+#define VIEWER_MARK_STRIDE 256 // lines between two entries of the sparse line index
+#define VIEWER_SCAN_BLOCK MB(1) // bytes read at a time by the indexer
+#define VIEWER_LINE_PEEK KB(64) // bytes of a line that are guaranteed to be mapped while drawing
+
+// the indexer reads the file through pread instead of the mapping, so that indexing
+// doesn't grow the resident set of the editor.
+static void* viewer_indexer(void* arg) {
+  struct viewer* vw = arg;
+  byte* block = mem_alloc(mem_io, VIEWER_SCAN_BLOCK);
+  u64 off = 0, newlines = 0;
+  posix_fadvise(vw->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  while (block != NULL && off < vw->size && !atomic_load(&vw->stop)) {
+    ssize_t got = pread(vw->fd, block, MIN(VIEWER_SCAN_BLOCK, vw->size - off), off);
+    if (got == -1 && errno == EINTR) continue;
+    if (got <= 0) break;
+    for (byte* p = block; (p = memchr(p, '\n', block + got - p)) != NULL; p++) {
+      if (++newlines % VIEWER_MARK_STRIDE != 0) continue;
+      pthread_mutex_lock(&vw->lock);
+      if (vw->nmarks == vw->cap) {
+        u64* marks = mem_realloc(mem_lines, vw->marks, sizeof(u64) * vw->cap * 2);
+        if (marks == NULL) {
+          pthread_mutex_unlock(&vw->lock);
+          goto done;
+        }
+        vw->marks = marks;
+        vw->cap *= 2;
+      }
+      vw->marks[vw->nmarks++] = off + (p - block) + 1;
+      pthread_mutex_unlock(&vw->lock);
+    }
+    off += got;
+    atomic_store(&vw->newlines, newlines);
+    atomic_store(&vw->scanned, off);
+    wake_signal();
+  }
+  done:
+  mem_free(mem_io, block);
+  atomic_store(&vw->scanned, vw->size); // nothing more will be found
+  wake_signal();
+  return NULL;
+}
+
+static inline bool viewer_indexing(struct viewer* vw) {
+  return vw->fd != -1 && atomic_load(&vw->scanned) < vw->size;
+}
+
+// number of lines that can be located so far
+static inline u64 viewer_lines(struct viewer* vw) {
+  u64 newlines = atomic_load(&vw->newlines);
+  return viewer_indexing(vw) ? newlines : newlines + 1;
+}
+
+// opens filepath in the viewer. returns false, with a warning in status, if it can't be
+static bool viewer_open(Editor* ed, const char* filepath) {
+  struct viewer* vw = &ed->viewer;
+  struct stat st;
+  vw->fd = open(filepath, O_RDONLY | O_CLOEXEC);
+  if (vw->fd == -1 || fstat(vw->fd, &st) == -1) {
+    set_status(ed, st_warn, "open: %s", strerror(errno));
+    goto failed;
+  }
+  vw->size = st.st_size;
+  vw->cap = 1024;
+  vw->marks = mem_alloc(mem_lines, sizeof(u64) * vw->cap);
+  if (vw->marks == NULL) {
+    set_status(ed, st_warn, "viewer_open: %s", strerror(errno));
+    goto failed;
+  }
+  vw->marks[vw->nmarks++] = 0;
+  pthread_mutex_init(&vw->lock, NULL);
+  atomic_init(&vw->stop, false);
+  atomic_init(&vw->newlines, 0);
+  atomic_init(&vw->scanned, 0);
+  int err = pthread_create(&vw->indexer, NULL, viewer_indexer, vw);
+  if (err != 0) {
+    set_status(ed, st_warn, "viewer_open: %s", strerror(err));
+    pthread_mutex_destroy(&vw->lock);
+    goto failed;
+  }
+  ed->mode = mode_view;
+  _reset(&ed->state, blank);
+  return true;
+
+  failed:
+  mem_free(mem_lines, vw->marks);
+  if (vw->fd != -1) close(vw->fd);
+  *vw = (struct viewer){0};
+  vw->fd = -1;
+  return false;
+}
+
+static void viewer_close(Editor* ed) {
+  struct viewer* vw = &ed->viewer;
+  if (vw->fd == -1) return;
+  atomic_store(&vw->stop, true);
+  pthread_join(vw->indexer, NULL);
+  pthread_mutex_destroy(&vw->lock);
+  if (vw->map != NULL) {
+    munmap(vw->map, vw->map_len);
+  }
+  mem_free(mem_lines, vw->marks);
+  close(vw->fd);
+  *vw = (struct viewer){0};
+  vw->fd = -1;
+}
+
+// returns pointer to byte at off, with at least min(want, bytes till EOF) bytes mapped
+// after it. *avail is set to the number of mapped bytes from off.
+static const byte* viewer_map(struct viewer* vw, u64 off, u64 want, u64* avail) {
+  *avail = 0;
+  if (off >= vw->size) return NULL;
+  u64 map_end = vw->map_off + vw->map_len;
+  if (vw->map == NULL || off < vw->map_off || off >= map_end ||
+      (off + want > map_end && map_end < vw->size)) {
+    if (vw->map != NULL) {
+      munmap(vw->map, vw->map_len);
+      vw->map = NULL;
+    }
+    u64 page = sysconf(_SC_PAGESIZE);
+    u64 back = MIN(off, VIEWER_WINDOW / 4); // some room for scrolling back
+    vw->map_off = (off - back) / page * page;
+    vw->map_len = MIN(VIEWER_WINDOW, vw->size - vw->map_off);
+    void* map = mmap(NULL, vw->map_len, PROT_READ, MAP_PRIVATE, vw->fd, vw->map_off);
+    if (map == MAP_FAILED) return NULL;
+    vw->map = map;
+  }
+  *avail = vw->map_off + vw->map_len - off;
+  return vw->map + (off - vw->map_off);
+}
+
+// byte offset of line lno, which has to be indexed already
+static u64 viewer_line_offset(struct viewer* vw, u64 lno) {
+  u64 line, off;
+  if (vw->hint_line <= lno && lno - vw->hint_line < VIEWER_MARK_STRIDE) {
+    line = vw->hint_line;
+    off = vw->hint_off;
+  } else {
+    pthread_mutex_lock(&vw->lock);
+    off = vw->marks[lno / VIEWER_MARK_STRIDE];
+    pthread_mutex_unlock(&vw->lock);
+    line = lno - lno % VIEWER_MARK_STRIDE;
+  }
+  while (line < lno) {
+    u64 avail;
+    const byte* p = viewer_map(vw, off, VIEWER_LINE_PEEK, &avail);
+    if (p == NULL) break;
+    const byte* nl = memchr(p, '\n', avail);
+    if (nl == NULL) { // line continues past the mapped window
+      off += avail;
+      continue;
+    }
+    off += nl - p + 1;
+    line++;
+  }
+  vw->hint_line = lno;
+  vw->hint_off = off;
+  return off;
+}
+
+static void viewer_mov(Editor* ed, i64 lines) {
+  struct viewer* vw = &ed->viewer;
+  i64 last = viewer_lines(vw) - 1;
+  vw->curs = clamp((i64)vw->curs + lines, 0, MAX(last, 0));
+}
+
+static void viewer_key(Editor* ed, u32 ch) {
+  struct viewer* vw = &ed->viewer;
+  switch (ch) {
+    case KEY_UP: viewer_mov(ed, -1); break;
+    case KEY_DOWN: viewer_mov(ed, 1); break;
+    case KEY_PPAGE: viewer_mov(ed, -(LINES - 1)); break;
+    case KEY_NPAGE: viewer_mov(ed, LINES - 1); break;
+    case KEY_HOME: vw->curs = 0; break;
+    case KEY_END: viewer_mov(ed, viewer_lines(vw)); break;
+    case KEY_LEFT: if (vw->col > 0) vw->col--; break;
+    case KEY_RIGHT: vw->col++; break;
+    case CTRL('s'): set_status(ed, st_warn, "buffer is read-only."); break;
+  }
+}
+
+// redraws while the index grows, so that the progress on status line stays current
+static bool viewer_tick(Editor* ed) {
+  struct viewer* vw = &ed->viewer;
+  u64 scanned = atomic_load(&vw->scanned);
+  if (scanned == vw->reported) return false;
+  vw->reported = scanned;
+  return true;
+}
+
+static void viewer_draw(WINDOW* edwin, Editor* ed, u16 win_h, u16 win_w) {
+  struct viewer* vw = &ed->viewer;
+  const u16 content_w = win_w - LNO_PADDING;
+  const u64 known = viewer_lines(vw);
+  scroll_to(ed, vw->curs, vw->col, win_h, win_w);
+  print_statusln(edwin, ed, win_w);
+
+  u32 vy = 1;
+  for (; vy < win_h && ed->view.y + vy - 1 < known; vy++) {
+    u32 line = ed->view.y + vy - 1;
+    draw_lno(edwin, vy, line);
+
+    u64 avail;
+    const byte* p = viewer_map(vw, viewer_line_offset(vw, line), VIEWER_LINE_PEEK, &avail);
+    u32 vx = 0;
+    for (u64 i = 0; i < avail && p[i] != '\n' && vx < ed->view.x + content_w;) {
+      u32 ch;
+      i += utf8_decode(p + i, avail - i, &ch);
+      vx += draw_char(edwin, vy, vx, ch, ed->view.x, win_w);
+    }
+  }
+  if (vy < win_h) {
+    wattron(edwin, COLOR_PAIR(COMMENT_PAIR));
+    mvwprintw(edwin, vy, 0, "      ~");
+    wattroff(edwin, COLOR_PAIR(COMMENT_PAIR));
+  }
+  highlight_curs(edwin, vw->col - ed->view.x + LNO_PADDING, vw->curs - ed->view.y + 1);
+}
@@ -0,0 +1,384 @@
+#pragma once
+// watching the open file for modifications made by other programs.
+// the parent directory is watched instead of the file itself, so that files replaced
+// through rename (like most deploy scripts and editors do) are noticed as well.
+
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/inotify.h>
+
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+#define WATCH_SETTLE MSEC(150) // quiet period after the last event before reloading
+#define FOLLOW_BUDGET MB(4) // bytes ingested per tick, so that input stays responsive
+#define RELOAD_CHUNK KB(64) // characters of buffer compared with the file at a time
+
+static inline bool _disk_differs(struct stat* a, struct stat* b) {
+  return a->st_ino != b->st_ino ||
+    a->st_dev != b->st_dev ||
+    a->st_size != b->st_size ||
+    a->st_mtim.tv_sec != b->st_mtim.tv_sec ||
+    a->st_mtim.tv_nsec != b->st_mtim.tv_nsec;
+}
+
+// remembers the current on-disk state of the file as the one buffer is in sync with
+static inline void watch_sync(Editor* ed) {
+  if (stat(ed->bufname, &ed->watch.disk) == -1) {
+    ed->watch.disk = (struct stat){0};
+  }
+}
+
+static void watch_stop(Editor* ed) {
+  if (ed->watch.fd != -1) {
+    close(ed->watch.fd);
+  }
+  ed->watch.fd = -1;
+  ed->watch.pending = false;
+}
+
+static void watch_start(Editor* ed) {
+  watch_stop(ed);
+  char path[PATH_MAX];
+  strncpy(path, ed->bufname, PATH_MAX - 1);
+  path[PATH_MAX - 1] = '\0';
+  strncpy(ed->watch.name, basename(path), STLEN - 1);
+
+  strncpy(path, ed->bufname, PATH_MAX - 1);
+  ed->watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (ed->watch.fd == -1) return;
+  if (inotify_add_watch(ed->watch.fd, dirname(path), WATCH_EVENTS) == -1) {
+    watch_stop(ed);
+    return;
+  }
+  watch_sync(ed);
+}
+
+// reads the whole file and decodes it, detecting its line ending into eol.
+// caller owns the returned text
+static u32* _read_disk_text(Editor* ed, u32* len, off_t* size, enum eol* eol) {
+  int fd = open(ed->bufname, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return NULL;
+  struct stat st;
+  byte* raw = NULL;
+  u32* text = NULL;
+  if (fstat(fd, &st) == -1) goto done;
+  raw = mem_alloc(mem_io, st.st_size + 1);
+  text = mem_alloc(mem_io, sizeof(u32) * (st.st_size + 1));
+  if (raw == NULL || text == NULL) {
+    mem_free(mem_io, text);
+    text = NULL;
+    goto done;
+  }
+  usize got = 0;
+  while (got < (usize)st.st_size) {
+    ssize_t res = pread(fd, raw + got, st.st_size - got, got);
+    if (res == -1 && errno == EINTR) continue;
+    if (res <= 0) break; // file shrunk while reading
+    got += res;
+  }
+  *eol = eol_auto;
+  *len = utf8_decode_text(raw, got, text, eol);
+  *size = got;
+  done:
+  mem_free(mem_io, raw);
+  close(fd);
+  return text;
+}
+
+// reads up to n bytes at off, fewer only if the file ends before
+static usize _read_at(int fd, byte* dst, usize n, off_t off) {
+  usize got = 0;
+  while (got < n) {
+    ssize_t res = pread(fd, dst + got, n - got, off + got);
+    if (res == -1 && errno == EINTR) continue;
+    if (res <= 0) break;
+    got += res;
+  }
+  return got;
+}
+
+// what reload_from_disk compares buffer with the file through, RELOAD_CHUNK characters
+// at a time
+struct reload {
+  int fd;
+  off_t size;
+  enum eol eol; // of the file, buffer is encoded with it to compare
+  u32* chars;
+  byte* enc; // chars encoded
+  byte* raw; // bytes of the file
+};
+
+// line ending of the file, settled on its first '\n'. fallback if it has none
+static enum eol _reload_eol(struct reload* r, enum eol fallback) {
+  byte prev = '\0';
+  for (off_t off = 0; off < r->size;) {
+    usize got = _read_at(r->fd, r->raw, MIN(RELOAD_CHUNK, r->size - off), off);
+    if (got == 0) break;
+    const byte* nl = memchr(r->raw, '\n', got);
+    if (nl != NULL) return (nl > r->raw ? nl[-1] : prev) == '\r' ? eol_crlf : eol_lf;
+    prev = r->raw[got - 1];
+    off += got;
+  }
+  return fallback;
+}
+
+// characters at the start of buffer that encode to the bytes the file starts with.
+// *bytes is set to the bytes they take. it never ends on a '\r' or an escaped byte,
+// which could decode along with the bytes after it
+static u32 _reload_prefix(Editor* ed, struct reload* r, off_t* bytes) {
+  u32 len = GAP_LEN(&ed->buffer), same = 0;
+  off_t at = 0;
+  while (same < len) {
+    u32 n = MIN(RELOAD_CHUNK, len - same);
+    gap_copy(&ed->buffer, same, n, r->chars);
+    usize m = utf8_encode_text(r->chars, n, r->enc, r->eol);
+    usize got = _read_at(r->fd, r->raw, MIN(m, r->size - at), at);
+    if (got == m && memcmp(r->enc, r->raw, m) == 0) {
+      same += n;
+      at += m;
+      continue;
+    }
+    for (u32 i = 0, w = 0, off = 0; i < n; i++, same++, at += w, off += w) { // to the first differing one
+      w = utf8_encode_text(r->chars + i, 1, r->enc, r->eol);
+      if (off + w > got || memcmp(r->enc, r->raw + off, w) != 0) break;
+    }
+    break;
+  }
+  for (u32 ch; same > 0 && ((ch = gap_get(&ed->buffer, same - 1)) == '\r' || utf8_is_escape(ch)); same--) {
+    at--;
+  }
+  *bytes = at;
+  return same;
+}
+
+// characters at the end of buffer, up to limit, that encode to the bytes the file ends
+// with, the bytes before from excluded. *bytes is set to the bytes they take. it never
+// starts with an escaped byte, which could decode along with the bytes before it
+static u32 _reload_suffix(Editor* ed, struct reload* r, u32 limit, off_t from, off_t* bytes) {
+  u32 len = GAP_LEN(&ed->buffer), same = 0;
+  off_t at = 0;
+  while (same < limit) {
+    u32 n = MIN(RELOAD_CHUNK, limit - same);
+    gap_copy(&ed->buffer, len - same - n, n, r->chars);
+    usize m = utf8_encode_text(r->chars, n, r->enc, r->eol);
+    usize want = MIN(m, r->size - from - at);
+    if (_read_at(r->fd, r->raw, want, r->size - at - want) != want) break;
+    if (want == m && memcmp(r->enc, r->raw, m) == 0) {
+      same += n;
+      at += m;
+      continue;
+    }
+    for (u32 i = n, w = 0, off = 0; i-- > 0; same++, at += w, off += w) { // back to the last differing one
+      w = utf8_encode_text(r->chars + i, 1, r->enc, r->eol);
+      if (off + w > want || memcmp(r->enc, r->raw + want - off - w, w) != 0) break;
+    }
+    break;
+  }
+  for (; same > 0 && utf8_is_escape(gap_get(&ed->buffer, len - same)); same--) {
+    at--;
+  }
+  *bytes = at;
+  return same;
+}
+
+// applies only the region of the file that differs from buffer. buffer is compared
+// with the file from both ends a chunk at a time, and only the bytes in between are
+// read whole and decoded
+static void reload_from_disk(Editor* ed) {
+  struct reload r = { .fd = open(ed->bufname, O_RDONLY | O_CLOEXEC) };
+  struct stat st;
+  byte* raw = NULL;
+  u32* text = NULL;
+  int err = 0;
+  if (r.fd == -1 || fstat(r.fd, &st) == -1) {
+    err = errno;
+    goto done;
+  }
+  r.size = st.st_size;
+  r.chars = mem_alloc(mem_io, sizeof(u32) * RELOAD_CHUNK);
+  r.enc = mem_alloc(mem_io, RELOAD_CHUNK * 4 + RELOAD_CHUNK); // room for a '\r' before each '\n'
+  r.raw = mem_alloc(mem_io, RELOAD_CHUNK * 4 + RELOAD_CHUNK);
+  if (r.chars == NULL || r.enc == NULL || r.raw == NULL) {
+    err = ENOMEM;
+    goto done;
+  }
+
+  r.eol = _reload_eol(&r, ed->eol);
+  off_t head, tail;
+  u32 len = GAP_LEN(&ed->buffer);
+  u32 prefix = _reload_prefix(ed, &r, &head);
+  u32 suffix = _reload_suffix(ed, &r, len - prefix, head, &tail);
+  usize n = r.size - head - tail;
+  raw = mem_alloc(mem_io, n + 1);
+  text = mem_alloc(mem_io, sizeof(u32) * (n + 1));
+  if (raw == NULL || text == NULL) {
+    err = ENOMEM;
+    goto done;
+  }
+  n = _read_at(r.fd, raw, n, head); // shorter if the file shrunk since
+  enum eol eol = r.eol;
+  u32 added = utf8_decode_text(raw, n, text, &eol);
+
+  if (added > 0 || prefix + suffix != len) {
+    u32 end = len - suffix, curs = cursi(ed);
+    if (curs >= end) {
+      curs = curs - end + prefix + added;
+    } else if (curs > prefix) {
+      curs = MIN(curs, prefix + added);
+    }
+    editor_replace(ed, prefix, end, text, added);
+    curs_goto(ed, curs);
+    _reset(&ed->state, unwritten_buffer);
+    set_status(ed, st_norm, "file changed on disk, reloaded %d characters.", added);
+  }
+  if (r.eol != ed->eol) { // every character is encoded differently
+    synced_edit(&ed->synced, 0);
+  }
+  ed->synced.dirty = SYNCED_NONE;
+  if (r.eol == eol_crlf && lf_bare_bytes(raw, n)) {
+    synced_edit(&ed->synced, prefix); // saving writes it with "\r\n" instead
+  }
+  ed->eol = r.eol;
+  ed->watch.offset = head + n + tail;
+
+  done:
+  mem_free(mem_io, raw);
+  mem_free(mem_io, text);
+  mem_free(mem_io, r.chars);
+  mem_free(mem_io, r.enc);
+  mem_free(mem_io, r.raw);
+  if (r.fd != -1) close(r.fd);
+  if (err != 0) {
+    set_status(ed, st_warn, "reload failed: %s", strerror(err));
+    return;
+  }
+
+  // the file may have been replaced by a new one
+  if (ed->fp != NULL && fstat(fileno(ed->fp), &st) == 0 && st.st_ino != ed->watch.disk.st_ino) {
+    FILE* fp = fopen(ed->bufname, "r+e");
+    if (fp != NULL) {
+      fclose(ed->fp);
+      ed->fp = fp;
+    }
+  }
+}
+
+// brings buffer in sync with a file that was replaced or rewritten on disk
+static bool _reconcile(Editor* ed, struct stat* st) {
+  ed->watch.disk = *st;
+  diff_invalidate(&ed->diff);
+  if (_has(ed->state, unwritten_buffer)) { // never drop changes made by the user
+    synced_edit(&ed->synced, 0); // nothing buffer has is known to be in the file anymore
+    _set(&ed->state, stale);
+    set_status(ed, st_warn, "file changed on disk!");
+    return true;
+  }
+  reload_from_disk(ed);
+  watch_sync(ed);
+  return true;
+}
+
+// follow mode: decodes bytes appended to the file since last time straight into the
+// end of buffer. the file is never read again from the start unless it shrinks or is
+// replaced (log rotation), in which case it is reconciled like any other change.
+static bool follow_ingest(Editor* ed) {
+  struct stat st;
+  if (ed->fp == NULL || stat(ed->bufname, &st) == -1) return false;
+  if (st.st_ino != ed->watch.disk.st_ino || st.st_size < ed->watch.offset) {
+    ed->watch.behind = false;
+    return _reconcile(ed, &st);
+  }
+  usize want = MIN(st.st_size - ed->watch.offset, FOLLOW_BUDGET);
+  ed->watch.behind = false;
+  if (want == 0) return false;
+
+  byte* raw = mem_alloc(mem_io, want);
+  u32* text = mem_alloc(mem_io, sizeof(u32) * want);
+  if (raw == NULL || text == NULL) {
+    mem_free(mem_io, raw);
+    mem_free(mem_io, text);
+    return false;
+  }
+  usize got = 0;
+  while (got < want) {
+    ssize_t res = pread(fileno(ed->fp), raw + got, want - got, ed->watch.offset + got);
+    if (res == -1 && errno == EINTR) continue;
+    if (res <= 0) break;
+    got += res;
+  }
+  usize usable = utf8_complete_len(raw, got); // rest is read again once completed
+  if (ed->eol == eol_crlf && usable > 0 && raw[usable - 1] == '\r') {
+    usable--; // may be the first half of a line ending
+  }
+  enum eol eol = ed->eol;
+  u32 n = utf8_decode_text(raw, usable, text, &eol);
+  if (ed->eol == eol_auto && memchr(raw, '\n', usable) != NULL) {
+    ed->eol = eol;
+  }
+  u32 len = GAP_LEN(&ed->buffer);
+  bool at_end = cursi(ed) == len;
+  buffer_append_raw(ed, text, n);
+  if (ed->eol == eol_crlf && lf_bare_bytes(raw, usable)) {
+    synced_edit(&ed->synced, len); // saving writes it with "\r\n" instead
+  }
+  diff_invalidate(&ed->diff); // appended lines are on disk too
+  if (at_end) {
+    curs_goto(ed, GAP_LEN(&ed->buffer));
+  }
+  mem_free(mem_io, raw);
+  mem_free(mem_io, text);
+
+  ed->watch.offset += usable;
+  synced_add(&ed->synced, GAP_LEN(&ed->buffer), ed->watch.offset);
+  ed->watch.disk = st;
+  ed->watch.disk.st_size = ed->watch.offset;
+  ed->watch.behind = usable > 0 && ed->watch.offset < st.st_size;
+  return n > 0;
+}
+
+// ms left until the file is taken as settled after the last event
+static inline i32 watch_settle_left(Editor* ed) {
+  f32 left = WATCH_SETTLE - elapsed_seconds(&ed->watch.last_event);
+  return left > 0 ? (i32)(left * 1000) + 1 : 0;
+}
+
+// consumes pending inotify events. returns true if buffer was changed
+static bool watch_poll(Editor* ed) {
+  if (ed->watch.fd == -1) return false;
+  byte events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  while ((len = read(ed->watch.fd, events, sizeof(events))) > 0) {
+    for (byte* p = events; p < events + len;) {
+      struct inotify_event* ev = (struct inotify_event*)p;
+      if (ev->len > 0 && strcmp(ev->name, ed->watch.name) == 0) {
+        ed->watch.pending = true;
+        clock_gettime(CLOCK_MONOTONIC, &ed->watch.last_event);
+      }
+      p += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+
+  if (_has(ed->state, saving)) return false;
+  if (ed->watch.follow) {
+    if (!ed->watch.pending && !ed->watch.behind) return false;
+    ed->watch.pending = false;
+    return follow_ingest(ed);
+  }
+  if (!ed->watch.pending) return false;
+  if (elapsed_seconds(&ed->watch.last_event) < WATCH_SETTLE) return false;
+  ed->watch.pending = false;
+
+  struct stat st;
+  if (stat(ed->bufname, &st) == -1 || !_disk_differs(&st, &ed->watch.disk)) return false;
+  return _reconcile(ed, &st);
+}
+
+static void watch_follow_toggle(Editor* ed) {
+  if (ed->watch.fd == -1) {
+    set_status(ed, st_warn, "nothing to follow, buffer has no file.");
+    return;
+  }
+  load_finish(ed); // appends continue from the end of what was loaded
+  ed->watch.follow = !ed->watch.follow;
+  ed->watch.behind = ed->watch.follow;
+  set_status(ed, st_norm, "follow mode %s.", ed->watch.follow ? "on" : "off");
+}
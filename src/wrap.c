@@ -0,0 +1,85 @@
+#pragma once
+// soft wrap: a line too long for the window goes on over as many rows as it needs
+// instead of scrolling sideways. include/wrap.h keeps the rows of each line, so that
+// scrolling, drawing and moving the cursor up and down map between rows and lines
+// without walking the lines before. lines are wrapped again only once edited, or all
+// of them when the window width changes. toggled with >wrap.
+
+static u32 vlen(Editor* ed, u32 start, u32 end);
+static inline u8 char_width(u32 ch, u32 vx);
+
+// rows line takes wrapped at width. the cursor past its end needs a column too
+static inline u32 _wrap_rows(Editor* ed, u32 line, u16 width) {
+  u32 start = lnbeg(ed, line);
+  return vlen(ed, start, start + lnlen(ed, line)) / width + 1;
+}
+
+static u32 _wrap_line_rows(void* arg, u32 line) {
+  Editor* ed = arg;
+  return _wrap_rows(ed, line, ed->wrap.width);
+}
+
+// brings the layout up to date for lines wrapped at width: all lines if width changed,
+// or else just those edited since
+static void wrap_settle(Editor* ed, u16 width) {
+  struct wrap* w = &ed->wrap;
+  u32 n = lncount(ed);
+  if (width != w->width || n != wrap_lines(w)) {
+    w->width = width;
+    w->stale_from = w->stale_to = 0;
+    wrap_reset(w, n, &ed->folds, _wrap_line_rows, ed);
+    return;
+  }
+  for (u32 line = w->stale_from; line < MIN(w->stale_to, n); line++) {
+    wrap_set(w, line, _wrap_rows(ed, line, width), fold_hidden(&ed->folds, line));
+  }
+  w->stale_from = w->stale_to = 0;
+  if (w->folds != ed->folds.rev) {
+    wrap_hide(w, &ed->folds);
+  }
+}
+
+// visual column of cursor in its row
+static inline u32 wrap_column(Editor* ed) {
+  return vlen(ed, lnbeg(ed, cursy(ed)), cursi(ed)) % ed->wrap.width;
+}
+
+// moves cursor up by times rows on screen, down if negative, to the column it was
+// last put at in its row
+static void wrap_curs_vertical(Editor* ed, i32 times) {
+  struct wrap* w = &ed->wrap;
+  wrap_settle(ed, w->width);
+  u32 vx = vlen(ed, lnbeg(ed, cursy(ed)), cursi(ed));
+  u32 row = wrap_row(w, cursy(ed)) + vx / w->width, last = wrap_total(w) - 1;
+  u32 target = times > 0 ? row - MIN(times, row) : MIN(row + -(i64)times, last);
+  if (target == row) return;
+
+  u32 sub, line = wrap_line(w, target, &sub);
+  u32 start = lnbeg(ed, line), len = lnlen(ed, line), want = sub * w->width + ed->sticky_curs;
+  u32 i = 0;
+  for (u32 col = 0; i < len; i++) { // up to the last character starting in the row before want
+    u32 next = col + char_width(gap_get(&ed->buffer, start + i), col);
+    if (next > want || next / w->width > sub) break;
+    col = next;
+  }
+  buffer_thaw(ed);
+  gap_move(&ed->buffer, start + i);
+  lnmove(ed, line + 1);
+}
+
+static void wrap_toggle(Editor* ed) {
+  struct wrap* w = &ed->wrap;
+  if (ed->mode != mode_edit) {
+    set_status(ed, st_warn, "only text can be wrapped.");
+    return;
+  }
+  ed->view.sub = 0;
+  ed->drawn.valid = false;
+  if (w->on) {
+    wrap_free(w);
+    set_status(ed, st_norm, "wrap off.");
+    return;
+  }
+  w->on = true; // lines are wrapped once drawn at the width of the window
+  set_status(ed, st_norm, "wrap on.");
+}
@@ -0,0 +1,73 @@
+// generates src/include/width.h, the display width table used by the editor.
+// widths are taken from the C.UTF-8 locale of the machine running the generator,
+// so the editor doesn't depend on the locale of the machine it runs on.
+//
+//   cc tools/gen_width.c -o gen_width && ./gen_width > src/include/width.h
+
+#define _XOPEN_SOURCE 700
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#define CODEPOINTS 0x110000
+#define BLOCK 256 // codepoints per stage 2 block
+#define BLOCK_BYTES (BLOCK / 4) // widths are packed 2 bits each
+
+static unsigned char blocks[CODEPOINTS / BLOCK][BLOCK_BYTES];
+static unsigned char index_of[CODEPOINTS / BLOCK];
+
+int main(void) {
+  if (setlocale(LC_CTYPE, "C.UTF-8") == NULL && setlocale(LC_CTYPE, "C.utf8") == NULL) {
+    fprintf(stderr, "gen_width: C.UTF-8 locale is not available\n");
+    return EXIT_FAILURE;
+  }
+  unsigned unique = 0;
+  for (unsigned b = 0; b < CODEPOINTS / BLOCK; b++) {
+    unsigned char block[BLOCK_BYTES] = {0};
+    for (unsigned i = 0; i < BLOCK; i++) {
+      int w = wcwidth(b * BLOCK + i);
+      if (w > 2) w = 2;
+      block[i / 4] |= (w + 1) << (i % 4 * 2); // -1 (not printable) is stored as 0
+    }
+    unsigned k = 0;
+    while (k < unique && memcmp(blocks[k], block, BLOCK_BYTES) != 0) k++;
+    if (k == unique) {
+      if (unique == 256) {
+        fprintf(stderr, "gen_width: too many distinct blocks\n");
+        return EXIT_FAILURE;
+      }
+      memcpy(blocks[unique++], block, BLOCK_BYTES);
+    }
+    index_of[b] = k;
+  }
+
+  printf("#pragma once\n");
+  printf("// generated by tools/gen_width.c, do not edit.\n");
+  printf("// display width of every codepoint as a two stage table: the high bits of a codepoint\n");
+  printf("// select one of the distinct blocks of %d codepoints, whose widths are packed 2 bits each.\n\n", BLOCK);
+  printf("#include \"itypes.h\"\n\n");
+  printf("static const u8 _width_index[%d] = {", CODEPOINTS / BLOCK);
+  for (unsigned b = 0; b < CODEPOINTS / BLOCK; b++) {
+    printf("%s%u,", b % 24 == 0 ? "\n  " : " ", index_of[b]);
+  }
+  printf("\n};\n\n");
+  printf("static const u8 _width_blocks[%u][%d] = {\n", unique, BLOCK_BYTES);
+  for (unsigned k = 0; k < unique; k++) {
+    printf("  {");
+    for (unsigned i = 0; i < BLOCK_BYTES; i++) {
+      printf("%s0x%02x,", i % 16 == 0 ? "\n    " : " ", blocks[k][i]);
+    }
+    printf("\n  },\n");
+  }
+  printf("};\n\n");
+  printf("// display width of cp: 0, 1 or 2 columns, -1 if it is not printable (like wcwidth)\n");
+  printf("static inline i8 ucs_width(u32 cp) {\n");
+  printf("  if (cp - 0x20 < 0x5F) return 1; // printable ascii\n");
+  printf("  if (cp >= 0x%X) return -1;\n", CODEPOINTS);
+  printf("  u8 packed = _width_blocks[_width_index[cp >> 8]][(cp & 0xFF) >> 2];\n");
+  printf("  return (i8)((packed >> ((cp & 3) * 2)) & 3) - 1;\n");
+  printf("}\n");
+  return EXIT_SUCCESS;
+}